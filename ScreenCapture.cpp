@@ -6,148 +6,2091 @@
 #include <gdiplus.h>
 #include <shlwapi.h>
 #include <dwmapi.h>
+#include <wincodec.h>
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include <emmintrin.h> // SSE2 is the baseline for this build
+#include "ScreenCaptureInternal.h"
 #include <string>
-#include <sstream>
+#include <map>
 #include <cwctype>
 
 #pragma comment(lib, "gdiplus.lib")
 #pragma comment(lib, "shlwapi.lib")
 #pragma comment(lib, "dwmapi.lib")
+#pragma comment(lib, "windowscodecs.lib")
+#pragma comment(lib, "ole32.lib")
+#pragma comment(lib, "oleaut32.lib")
 
 using namespace Gdiplus;
 
 static HINSTANCE g_hInst = NULL;
-static HHOOK g_hHook = NULL;
-static std::wstring g_basePath; // directory supplied by caller
 static ULONG_PTR g_gdiplusToken = 0;
 
+// ---- Per-thread hook registry ----
+// RecordScreen may be called from several UI threads, and the hook is
+// installed per thread — a single global handle/path pair meant the second
+// caller silently reused the first hook and clobbered the shared path
+// mid-capture. Each thread now keeps its own hook handle and base output
+// directory in thread_locals, so the GetMsgProc hot path and name building
+// read them with zero synchronization. The fixed-size slot array exists
+// only off the hot path: process detach walks it to unhook every thread.
+#define HOOK_SLOTS_MAX 16
+
+struct HookSlot {
+    volatile LONG threadId; // 0 = free; claimed with a CAS at registration
+    HHOOK hook;
+};
+
+static HookSlot g_hookSlots[HOOK_SLOTS_MAX];
+static thread_local HHOOK t_hHook = NULL;
+static thread_local WCHAR t_basePath[MAX_PATH]; // this thread's output dir
+
 // Forward declarations
-static BOOL GetExtendedRect(HWND hwnd, RECT* prc);
+struct WindowMeta;
+static bool BuildBaseName(const WindowMeta& meta, WCHAR* out, size_t cap);
+static void NextUniquePath(const WCHAR* base, WCHAR* out, size_t cap);
+static bool DxgiGrabRect(const RECT& rcScreen, BYTE* dst, int w, int h, UINT dstStride);
+struct CaptureContext;
+static void SeedFromScreen(CaptureContext* ctx, HDC hScreenDC, const RECT& rcExt,
+                           void* dibBits, int w, int h);
+
+// PNG encoder CLSID, resolved once at first-capture init. GetEncoderClsid
+// enumerates every installed codec (GetImageEncodersSize + malloc + linear
+// scan), which is far too much work to repeat per capture.
+static CLSID g_pngClsid;
+static volatile LONG g_pngClsidState = 0; // 0 unresolved, 1 resolved, -1 failed
+
+static bool GetCachedPngClsid(CLSID* out);
 
 // Helper: get CLSID for PNG encoder
 static int GetEncoderClsid(const WCHAR* format, CLSID* pClsid) {
     UINT  num = 0;          // number of image encoders
     UINT  size = 0;         // size of the image encoder array in bytes
 
-    GetImageEncodersSize(&num, &size);
-    if (size == 0)
-        return -1;  // Failure
+    GetImageEncodersSize(&num, &size);
+    if (size == 0)
+        return -1;  // Failure
+
+    ImageCodecInfo* pImageCodecInfo = (ImageCodecInfo*)(malloc(size));
+    if (pImageCodecInfo == NULL)
+        return -1; // Failure
+
+    GetImageEncoders(num, size, pImageCodecInfo);
+    for (UINT j = 0; j < num; ++j) {
+        if (wcscmp(pImageCodecInfo[j].MimeType, format) == 0) {
+            *pClsid = pImageCodecInfo[j].Clsid;
+            free(pImageCodecInfo);
+            return j; // Success
+        }
+    }
+    free(pImageCodecInfo);
+    return -1; // Failure
+}
+
+// ---- First-capture initialization ----
+// The host loads this DLL in every session but only a fraction ever
+// capture, and GdiplusStartup inside DllMain both slowed every process
+// start and ran under the loader lock. Backend init (GDI+ and the PNG
+// CLSID lookup; WIC is already lazy per encoding thread) therefore runs
+// once on first use, from whichever thread captures or encodes first.
+static INIT_ONCE g_captureInitOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK CaptureInitProc(PINIT_ONCE, PVOID, PVOID*) {
+    GdiplusStartupInput gdiplusStartupInput;
+    GdiplusStartup(&g_gdiplusToken, &gdiplusStartupInput, NULL);
+    CLSID unused;
+    GetCachedPngClsid(&unused);
+    return TRUE;
+}
+
+static void EnsureCaptureInit() {
+    InitOnceExecuteOnce(&g_captureInitOnce, CaptureInitProc, NULL, NULL);
+}
+
+// ---- Capture statistics ----
+// Per-stage QueryPerformanceCounter accumulators (count, total, max) kept in
+// a named shared-memory section, "Local\ScreenCaptureStats_<pid>", so a
+// monitoring agent can map the section and scrape timings without attaching
+// a debugger. Updates are interlocked; readers take a point-in-time snapshot
+// that may be mid-capture, which is fine for trend monitoring. Stage ids and
+// the block layout live in ScreenCaptureInternal.h so the bench shares them.
+
+static HANDLE g_statsMapping = NULL;
+static CaptureStats* volatile g_stats = NULL;
+static CaptureStats g_statsLocal; // fallback if the section cannot be created
+
+CaptureStats* GetStatsBlock() {
+    CaptureStats* stats = g_stats;
+    if (stats) return stats;
+    WCHAR name[64];
+    _snwprintf_s(name, _countof(name), _TRUNCATE,
+                 L"Local\\ScreenCaptureStats_%u", GetCurrentProcessId());
+    HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL,
+                                        PAGE_READWRITE, 0,
+                                        sizeof(CaptureStats), name);
+    CaptureStats* view = mapping
+        ? (CaptureStats*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0)
+        : NULL;
+    if (!view) view = &g_statsLocal;
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    view->cbSize = sizeof(CaptureStats);
+    view->qpcFrequency = freq.QuadPart;
+    // First thread to publish wins; a loser unmaps its redundant view (the
+    // named section itself is shared, so no counts are lost either way).
+    if (InterlockedCompareExchangePointer((volatile PVOID*)&g_stats, view, NULL) != NULL) {
+        if (view != &g_statsLocal) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        return g_stats;
+    }
+    g_statsMapping = mapping;
+    return view;
+}
+
+static LONG64 StatClockStart() {
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return li.QuadPart;
+}
+
+// Most recent per-stage duration on this thread, in microseconds; the
+// capture journal snapshots these to attribute stage times to one capture.
+static thread_local DWORD t_lastStageUs[StageStatCount];
+
+static void StatClockStop(int stageIdx, LONG64 startQpc) {
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    LONG64 elapsed = li.QuadPart - startQpc;
+    CaptureStats* stats = GetStatsBlock();
+    if (stats->qpcFrequency) {
+        t_lastStageUs[stageIdx] = (DWORD)(elapsed * 1000000 / stats->qpcFrequency);
+    }
+    CaptureStageStats* s = &stats->stage[stageIdx];
+    InterlockedIncrement64(&s->count);
+    InterlockedExchangeAdd64(&s->totalQpc, elapsed);
+    for (;;) {
+        LONG64 prev = s->maxQpc;
+        if (elapsed <= prev) break;
+        if (InterlockedCompareExchange64(&s->maxQpc, elapsed, prev) == prev) break;
+    }
+}
+
+// ---- Capture journal ----
+// An append-only memory-mapped file, "captures.journal" in the output
+// directory, with one fixed-size record per capture: title hash, tick,
+// dimensions, stage timings, and the final filename. Tooling indexes a run
+// by mapping this one file instead of statting thousands of images. A
+// writer claims its slot with one interlocked increment and flips the
+// record's committed flag when done — no locks and no flushes on the hot
+// path; the OS writes pages back lazily and records survive a crash up to
+// the last committed one. The journal opens alongside the first registered
+// output directory and keeps appending across sessions.
+
+// The header occupies a full allocation granularity (64 KB): record chunks
+// are mapped as separate views, and MapViewOfFile rejects any file offset
+// that is not granularity-aligned, so the first chunk must start on a
+// 64 KB boundary (1 MB chunks keep every later offset aligned too).
+#define JOURNAL_HEADER_BYTES 65536
+#define JOURNAL_CHUNK_BYTES (1u << 20)
+#define JOURNAL_MAX_CHUNKS 256
+
+struct JournalHeader {
+    char magic[4];          // "SCJL"
+    DWORD version;          // 2: 64 KB header, aligned record chunks
+    DWORD recordSize;       // sizeof(JournalRecord)
+    volatile LONG nextSlot; // total records ever claimed
+};
+
+struct JournalRecord {
+    volatile LONG committed; // 0 until the record is fully written
+    DWORD titleHash;         // FNV-1a of the sanitized window name
+    DWORD tickMs;            // GetTickCount at submit
+    DWORD width, height;     // frame dimensions
+    DWORD blitUs, printUs;   // grab-side stage times for this capture
+    DWORD encodeUs, writeUs; // encoder-side stage times for this capture
+    WCHAR fileName[80];      // name within the capture directory
+};
+
+static HANDLE g_journalFile = INVALID_HANDLE_VALUE;
+static JournalHeader* g_journalHeader = NULL;
+static BYTE* g_journalChunks[JOURNAL_MAX_CHUNKS]; // record views, never unmapped
+static SRWLOCK g_journalLock = SRWLOCK_INIT;      // guards open/extend only
+
+static DWORD FnvHashW(const WCHAR* s) {
+    DWORD h = 2166136261u;
+    for (; *s; ++s) {
+        h ^= (DWORD)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Maps (extending the file as needed) the chunk that holds record views for
+// the given chunk index. Views are kept for the life of the process so
+// records handed to the encoder thread stay valid across growth.
+static BYTE* JournalMapChunk(DWORD chunk) {
+    BYTE* view = g_journalChunks[chunk];
+    if (view) return view;
+    AcquireSRWLockExclusive(&g_journalLock);
+    view = g_journalChunks[chunk];
+    if (!view && g_journalFile != INVALID_HANDLE_VALUE) {
+        LONGLONG end = JOURNAL_HEADER_BYTES +
+                       (LONGLONG)(chunk + 1) * JOURNAL_CHUNK_BYTES;
+        HANDLE mapping = CreateFileMappingW(g_journalFile, NULL, PAGE_READWRITE,
+                                            (DWORD)(end >> 32), (DWORD)end, NULL);
+        if (mapping) {
+            LONGLONG off = JOURNAL_HEADER_BYTES +
+                           (LONGLONG)chunk * JOURNAL_CHUNK_BYTES;
+            view = (BYTE*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS,
+                                        (DWORD)(off >> 32), (DWORD)off,
+                                        JOURNAL_CHUNK_BYTES);
+            CloseHandle(mapping); // the view keeps the section alive
+            g_journalChunks[chunk] = view;
+        }
+    }
+    ReleaseSRWLockExclusive(&g_journalLock);
+    return view;
+}
+
+// Opens (or reopens across sessions) the journal next to the given output
+// directory. First registered directory wins; later threads append to the
+// same journal regardless of their own base path.
+static void JournalEnsureOpen(const WCHAR* dir) {
+    if (g_journalHeader) return;
+    AcquireSRWLockExclusive(&g_journalLock);
+    if (!g_journalHeader) {
+        WCHAR path[MAX_PATH];
+        _snwprintf_s(path, _countof(path), _TRUNCATE, L"%s%scaptures.journal",
+                     dir, (dir[0] && dir[wcslen(dir) - 1] == L'\\') ? L"" : L"\\");
+        HANDLE file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE,
+                                  FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                                  FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file != INVALID_HANDLE_VALUE) {
+            bool fresh = (GetLastError() != ERROR_ALREADY_EXISTS);
+            HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE,
+                                                0, JOURNAL_HEADER_BYTES, NULL);
+            JournalHeader* hdr = mapping
+                ? (JournalHeader*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS,
+                                                0, 0, JOURNAL_HEADER_BYTES)
+                : NULL;
+            if (mapping) CloseHandle(mapping);
+            if (hdr) {
+                if (fresh || memcmp(hdr->magic, "SCJL", 4) != 0 ||
+                    hdr->version != 2 ||
+                    hdr->recordSize != sizeof(JournalRecord)) {
+                    // Also restarts v1 journals: their 4 KB header left the
+                    // record chunks unmappable, so they never held a record
+                    memcpy(hdr->magic, "SCJL", 4);
+                    hdr->version = 2;
+                    hdr->recordSize = sizeof(JournalRecord);
+                    hdr->nextSlot = 0;
+                }
+                g_journalFile = file;
+                g_journalHeader = hdr;
+            } else {
+                CloseHandle(file);
+            }
+        }
+    }
+    ReleaseSRWLockExclusive(&g_journalLock);
+}
+
+// Claims the next record slot. Returns NULL when the journal is unavailable
+// (captures proceed without metadata; they always have).
+static JournalRecord* JournalClaim() {
+    JournalHeader* hdr = g_journalHeader;
+    if (!hdr) return NULL;
+    LONG slot = InterlockedIncrement(&hdr->nextSlot) - 1;
+    const DWORD perChunk = JOURNAL_CHUNK_BYTES / sizeof(JournalRecord);
+    DWORD chunk = (DWORD)slot / perChunk;
+    if (chunk >= JOURNAL_MAX_CHUNKS) return NULL;
+    BYTE* view = JournalMapChunk(chunk);
+    if (!view) return NULL;
+    return (JournalRecord*)(view + ((DWORD)slot % perChunk) * sizeof(JournalRecord));
+}
+
+// ---- Asynchronous PNG encoding ----
+// GetMsgProc runs on the hooked UI thread; GDI+ PNG compression of a large
+// window can take hundreds of milliseconds, so the hook only grabs pixels and
+// hands the HBITMAP to a background encoder thread through a bounded
+// lock-free queue (Vyukov-style ring with per-slot sequence numbers).
+
+struct EncodeJob {
+    HBITMAP hBmp;             // owned by the queue once enqueued
+    WCHAR path[MAX_PATH];
+    JournalRecord* journal;   // pending journal record, or NULL
+};
+
+#define ENCODE_QUEUE_CAPACITY 16 // must be a power of two
+
+struct EncodeSlot {
+    volatile LONG sequence;
+    EncodeJob job;
+};
+
+static EncodeSlot g_encodeQueue[ENCODE_QUEUE_CAPACITY];
+static volatile LONG g_encodeHead = 0; // next slot producers claim
+static volatile LONG g_encodeTail = 0; // next slot the encoder thread drains
+static HANDLE g_encodeThread = NULL;
+static HANDLE g_encodeWake = NULL;     // released once per enqueued job
+static volatile LONG g_encodeStop = 0;
+
+// ---- PNG encoding backend ----
+// WIC is the primary encoder: unlike the GDI+ image/png codec it exposes the
+// PNG filter strategy, which dominates compression cost. "Fast" skips
+// filtering entirely (~15% larger files for a several-times-faster encode);
+// "best" uses adaptive filtering like GDI+ always did. GDI+ remains the
+// fallback when WIC is unavailable. The level/format enums live in
+// ScreenCaptureInternal.h.
+
+volatile LONG g_compressionLevel = CompressionDefault;
+volatile LONG g_outputFormat = FormatPng;
+volatile LONG g_jpegQuality = 90; // percent, lossy mode only
+
+static const WCHAR* FormatExtension() {
+    switch (g_outputFormat) {
+    case FormatBmp:  return L".bmp";
+    case FormatQoi:  return L".qoi";
+    case FormatJpeg: return L".jpg";
+    case FormatQoiBanded: return L".qot";
+    default:         return L".png";
+    }
+}
+
+// Per-thread WIC factory; created lazily so only threads that actually
+// encode pay for COM init (the encoder thread in practice).
+static thread_local IWICImagingFactory* t_wicFactory = NULL;
+static thread_local bool t_wicAttempted = false;
+static thread_local bool t_wicCoInit = false; // this thread owes a CoUninitialize
+
+static IWICImagingFactory* GetWicFactory() {
+    if (!t_wicAttempted) {
+        t_wicAttempted = true;
+        // RPC_E_CHANGED_MODE is fine, but then the init is not ours to undo
+        t_wicCoInit = SUCCEEDED(CoInitializeEx(NULL, COINIT_MULTITHREADED));
+        CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER,
+                         IID_PPV_ARGS(&t_wicFactory));
+    }
+    return t_wicFactory;
+}
+
+// Thread-detach counterpart: the transient batch/burst workers encode inline,
+// so each one that exits without this leaks a factory and a COM apartment ref.
+static void WicRelease() {
+    if (t_wicFactory) {
+        t_wicFactory->Release();
+        t_wicFactory = NULL;
+    }
+    if (t_wicCoInit) {
+        CoUninitialize();
+        t_wicCoInit = false;
+    }
+    t_wicAttempted = false;
+}
+
+// ---- Overlapped output writes ----
+// The encoder produces PNG bytes into memory and pushes them to disk with
+// overlapped WriteFile, so a slow network share never blocks the encoder
+// between frames. In-flight bytes are capped; at the cap the encoder waits
+// for the oldest write to land instead of growing memory without bound.
+// All of this state is touched only by the encoder thread.
+
+#define WRITE_IN_FLIGHT_CAP (64u << 20)
+
+struct PendingWrite {
+    HANDLE file;
+    OVERLAPPED ov;
+    HGLOBAL data;
+    DWORD size;
+    PendingWrite* next;
+};
+
+static PendingWrite* g_writeHead = NULL;
+static PendingWrite* g_writeTail = NULL;
+static SIZE_T g_writeInFlight = 0;
+
+static void ReapCompletedWrites(bool waitOldest) {
+    while (g_writeHead) {
+        PendingWrite* p = g_writeHead;
+        DWORD done = 0;
+        if (!GetOverlappedResult(p->file, &p->ov, &done, waitOldest)) {
+            if (!waitOldest && GetLastError() == ERROR_IO_INCOMPLETE) return;
+            // Any real write error: drop the buffer and move on
+        }
+        waitOldest = false; // only ever block on the oldest write
+        g_writeHead = p->next;
+        if (!g_writeHead) g_writeTail = NULL;
+        g_writeInFlight -= p->size;
+        CloseHandle(p->ov.hEvent);
+        CloseHandle(p->file);
+        GlobalUnlock(p->data);
+        GlobalFree(p->data);
+        free(p);
+    }
+}
+
+static void WriteBufferSync(const WCHAR* path, const void* bytes, DWORD size) {
+    LONG64 t0 = StatClockStart();
+    HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE) {
+        DWORD written = 0;
+        WriteFile(file, bytes, size, &written, NULL);
+        CloseHandle(file);
+    }
+    StatClockStop(StageWrite, t0);
+}
+
+// Starts an overlapped write of the encoded buffer; takes ownership of hg
+// either way (falling back to a synchronous write when overlapped setup
+// fails).
+static void QueueFileWrite(const WCHAR* path, HGLOBAL hg, DWORD size) {
+    LONG64 t0 = StatClockStart();
+    ReapCompletedWrites(false);
+    while (g_writeHead && g_writeInFlight + size > WRITE_IN_FLIGHT_CAP) {
+        ReapCompletedWrites(true);
+    }
+    PendingWrite* p = (PendingWrite*)calloc(1, sizeof(PendingWrite));
+    HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
+    void* bytes = GlobalLock(hg);
+    HANDLE ev = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (p && file != INVALID_HANDLE_VALUE && bytes && ev) {
+        p->file = file;
+        p->data = hg;
+        p->size = size;
+        p->ov.hEvent = ev;
+        if (WriteFile(file, bytes, size, NULL, &p->ov) ||
+            GetLastError() == ERROR_IO_PENDING) {
+            if (g_writeTail) g_writeTail->next = p; else g_writeHead = p;
+            g_writeTail = p;
+            g_writeInFlight += size;
+            StatClockStop(StageWrite, t0);
+            return;
+        }
+    }
+    // Overlapped setup failed: write in place (which times itself). The
+    // overlapped handle was opened with no sharing, so it must be closed
+    // before WriteBufferSync reopens the same path.
+    StatClockStop(StageWrite, t0);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    if (ev) CloseHandle(ev);
+    if (bytes) {
+        WriteBufferSync(path, bytes, size);
+        GlobalUnlock(hg);
+    }
+    GlobalFree(hg);
+    free(p);
+}
+
+// ---- Per-capture arena ----
+// Transient per-capture buffers (DDB pixel copies, hash scratch) come from
+// a per-thread bump arena instead of the process heap. The legacy 32-bit
+// hosts this DLL lands in carry old, fragmented heaps, and tens of
+// thousands of captures' worth of malloc/free churn makes that worse. The
+// arena keeps its high-water slab across captures, so a steady-state
+// capture performs zero general-heap allocations — ArenaReset just rewinds
+// the cursor. Encode output buffers stay on GlobalAlloc because overlapped
+// writes keep them alive past the capture that produced them.
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    SIZE_T cap;
+};
+
+static thread_local BYTE* t_arenaSlab = NULL; // high-water slab, reused
+static thread_local SIZE_T t_arenaCap = 0;
+static thread_local SIZE_T t_arenaUsed = 0;
+static thread_local ArenaBlock* t_arenaOverflow = NULL; // mid-capture growth
+
+static void* ArenaAlloc(SIZE_T bytes) {
+    bytes = (bytes + 15) & ~(SIZE_T)15;
+    if (t_arenaUsed + bytes <= t_arenaCap) {
+        void* p = t_arenaSlab + t_arenaUsed;
+        t_arenaUsed += bytes;
+        return p;
+    }
+    if (t_arenaUsed == 0) {
+        // Slab is empty, so it can be replaced outright with one that fits
+        SIZE_T cap = t_arenaCap ? t_arenaCap : (SIZE_T)1 << 16;
+        while (cap < bytes) cap *= 2;
+        BYTE* slab = (BYTE*)malloc(cap);
+        if (!slab) return NULL;
+        free(t_arenaSlab);
+        t_arenaSlab = slab;
+        t_arenaCap = cap;
+        t_arenaUsed = bytes;
+        return slab;
+    }
+    // Live data in the slab: chain an overflow block, folded into the main
+    // slab at the next reset
+    ArenaBlock* blk = (ArenaBlock*)malloc(sizeof(ArenaBlock) + bytes);
+    if (!blk) return NULL;
+    blk->next = t_arenaOverflow;
+    blk->cap = bytes;
+    t_arenaOverflow = blk;
+    return blk + 1;
+}
+
+// Rewinds the arena after a capture. Overflow blocks mean the slab was too
+// small for this workload; grow it now, while nothing is live, so the next
+// capture fits in one piece.
+static void ArenaReset() {
+    SIZE_T want = t_arenaUsed;
+    for (ArenaBlock* b = t_arenaOverflow; b;) {
+        ArenaBlock* next = b->next;
+        want += b->cap;
+        free(b);
+        b = next;
+    }
+    t_arenaOverflow = NULL;
+    t_arenaUsed = 0;
+    if (want > t_arenaCap) {
+        free(t_arenaSlab);
+        SIZE_T cap = t_arenaCap ? t_arenaCap : (SIZE_T)1 << 16;
+        while (cap < want) cap *= 2;
+        t_arenaSlab = (BYTE*)malloc(cap);
+        t_arenaCap = t_arenaSlab ? cap : 0;
+    }
+}
+
+// Returns the slab to the heap; called when one of our worker threads exits
+// (plain thread_local pointers get no destructor).
+static void ArenaRelease() {
+    ArenaReset();
+    free(t_arenaSlab);
+    t_arenaSlab = NULL;
+    t_arenaCap = 0;
+}
+
+// Resolves the pixel data of a capture bitmap as top-down 32bpp BGRA.
+// Capture bitmaps are DIB sections, so this is just a pointer into the
+// mapped bits; a foreign DDB costs one GetDIBits copy into the per-thread
+// arena (released by the ArenaReset at the end of the capture).
+static bool GetBitmapPixels(HBITMAP hBmp, int* outW, int* outH, UINT* outStride,
+                            BYTE** outPixels) {
+    *outPixels = NULL;
+    BITMAP bm = {};
+    if (!GetObjectW(hBmp, sizeof(bm), &bm)) return false;
+    int w = bm.bmWidth;
+    int h = bm.bmHeight;
+    if (w <= 0 || h <= 0) return false;
+    *outW = w;
+    *outH = h;
+
+    DIBSECTION ds = {};
+    if (GetObjectW(hBmp, sizeof(ds), &ds) == sizeof(ds) &&
+        ds.dsBm.bmBits && ds.dsBm.bmBitsPixel == 32 && ds.dsBmih.biHeight < 0) {
+        *outStride = (UINT)ds.dsBm.bmWidthBytes;
+        *outPixels = (BYTE*)ds.dsBm.bmBits;
+        return true;
+    }
+    BITMAPINFO bmi = {};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = w;
+    bmi.bmiHeader.biHeight = -h; // top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    UINT stride = (UINT)w * 4;
+    BYTE* copy = (BYTE*)ArenaAlloc((SIZE_T)stride * h);
+    if (!copy) return false;
+    HDC hdc = GetDC(NULL);
+    int got = hdc ? GetDIBits(hdc, hBmp, 0, h, copy, &bmi, DIB_RGB_COLORS) : 0;
+    if (hdc) ReleaseDC(NULL, hdc);
+    if (got != h) return false;
+    *outStride = stride;
+    *outPixels = copy;
+    return true;
+}
+
+// ---- Pixel-format row kernels ----
+// The per-pixel stages (delta, hash, downscale averaging, format
+// conversion) used to hard-code their 32bpp BGRA layout inline; as stages
+// accumulate, the layout lives in one compile-time traits point instead.
+// The kernels are templates over the pixel format, so every instantiation
+// is a loop with the channel count pinned — which is what the 32-bit MSVC
+// optimizer needs to keep them unrolled and vectorized. BGRA32 drives the
+// live pipeline (capture DIBs are always 32bpp top-down); BGR24 feeds the
+// JPEG encoder, which negotiates 24bpp.
+
+enum PixelFormatTag { PixelBgra32, PixelBgr24 };
+
+template <PixelFormatTag F> struct PixelTraits;
+template <> struct PixelTraits<PixelBgra32> {
+    static const int bytesPerPixel = 4;
+};
+template <> struct PixelTraits<PixelBgr24> {
+    static const int bytesPerPixel = 3;
+};
+
+#define XXH_PRIME1 2654435761u
+#define XXH_PRIME2 2246822519u
+#define XXH_PRIME3 3266489917u
+#define XXH_PRIME4 668265263u
+#define XXH_PRIME5 374761393u
+
+// xxHash32-style digest of one row: four rotating 32-bit lanes over the
+// bulk, a 4-byte tail, then a byte tail (24bpp rows are not always a
+// multiple of four bytes), and the avalanche finish.
+static DWORD HashRow(const BYTE* p, SIZE_T len, DWORD seed) {
+    const BYTE* end = p + len;
+    DWORD h;
+    if (len >= 16) {
+        DWORD v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+        DWORD v2 = seed + XXH_PRIME2;
+        DWORD v3 = seed;
+        DWORD v4 = seed - XXH_PRIME1;
+        const BYTE* limit = end - 16;
+        do {
+            v1 = _rotl(v1 + *(const DWORD*)(p + 0) * XXH_PRIME2, 13) * XXH_PRIME1;
+            v2 = _rotl(v2 + *(const DWORD*)(p + 4) * XXH_PRIME2, 13) * XXH_PRIME1;
+            v3 = _rotl(v3 + *(const DWORD*)(p + 8) * XXH_PRIME2, 13) * XXH_PRIME1;
+            v4 = _rotl(v4 + *(const DWORD*)(p + 12) * XXH_PRIME2, 13) * XXH_PRIME1;
+            p += 16;
+        } while (p <= limit);
+        h = _rotl(v1, 1) + _rotl(v2, 7) + _rotl(v3, 12) + _rotl(v4, 18);
+    } else {
+        h = seed + XXH_PRIME5;
+    }
+    h += (DWORD)len;
+    while (p + 4 <= end) {
+        h += *(const DWORD*)p * XXH_PRIME3;
+        h = _rotl(h, 17) * XXH_PRIME4;
+        p += 4;
+    }
+    while (p < end) {
+        h += *p++ * XXH_PRIME5;
+        h = _rotl(h, 11) * XXH_PRIME1;
+    }
+    h ^= h >> 15;
+    h *= XXH_PRIME2;
+    h ^= h >> 13;
+    h *= XXH_PRIME3;
+    h ^= h >> 16;
+    return h;
+}
+
+// Delta stage: row equality over the format's payload bytes.
+template <PixelFormatTag F>
+static bool RowsEqual(const BYTE* a, const BYTE* b, int w) {
+    return memcmp(a, b, (SIZE_T)w * PixelTraits<F>::bytesPerPixel) == 0;
+}
+
+// Hash stage: row digest over the payload bytes (stride padding stays out
+// of the digest).
+template <PixelFormatTag F>
+static DWORD HashRowPixels(const BYTE* row, int w, DWORD seed) {
+    return HashRow(row, (SIZE_T)w * PixelTraits<F>::bytesPerPixel, seed);
+}
+
+// Conversion stage: one row, specialized per source/destination pair so
+// the loop body is plain channel moves.
+template <PixelFormatTag Src, PixelFormatTag Dst>
+static void ConvertRow(const BYTE* src, BYTE* dst, int w);
+
+template <>
+void ConvertRow<PixelBgra32, PixelBgr24>(const BYTE* src, BYTE* dst, int w) {
+    for (int x = 0; x < w; ++x) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        src += 4;
+        dst += 3;
+    }
+}
+
+// Scale stage, horizontal pass: shrink one vertically-accumulated row
+// (per-channel UINT16 sums) into averaged destination pixels. The alpha
+// store compiles away for formats without an alpha byte.
+template <PixelFormatTag F>
+static void ShrinkAccRow(const UINT16* acc, int sw, int dw, UINT32 rows, BYTE* dst) {
+    const int bpp = PixelTraits<F>::bytesPerPixel;
+    for (int x = 0; x < dw; ++x) {
+        int x0 = MulDiv(x, sw, dw);
+        int x1 = MulDiv(x + 1, sw, dw);
+        if (x1 <= x0) x1 = x0 + 1;
+        UINT32 b = 0, g = 0, r = 0;
+        for (int xx = x0; xx < x1; ++xx) {
+            const UINT16* p = acc + (SIZE_T)xx * bpp;
+            b += p[0];
+            g += p[1];
+            r += p[2];
+        }
+        UINT32 cnt = rows * (UINT32)(x1 - x0);
+        UINT32 half = cnt / 2;
+        BYTE* out = dst + (SIZE_T)x * bpp;
+        out[0] = (BYTE)((b + half) / cnt);
+        out[1] = (BYTE)((g + half) / cnt);
+        out[2] = (BYTE)((r + half) / cnt);
+        if (bpp == 4) out[3] = 0xFF;
+    }
+}
+
+static bool SaveBitmapWic(HBITMAP hBmp, const WCHAR* path, bool asyncWrite,
+                          const GUID& container) {
+    IWICImagingFactory* factory = GetWicFactory();
+    if (!factory) return false;
+
+    int w, h;
+    UINT stride;
+    BYTE* pixels;
+    if (!GetBitmapPixels(hBmp, &w, &h, &stride, &pixels)) return false;
+
+    bool ok = false;
+    IStream* memStream = NULL;
+    IWICStream* stream = NULL;
+    IWICBitmapEncoder* encoder = NULL;
+    IWICBitmapFrameEncode* frame = NULL;
+    IPropertyBag2* props = NULL;
+    do {
+        if (FAILED(factory->CreateStream(&stream))) break;
+        if (asyncWrite) {
+            // Encode into memory; the bytes go to disk via overlapped I/O
+            if (FAILED(CreateStreamOnHGlobal(NULL, FALSE, &memStream))) break;
+            if (FAILED(stream->InitializeFromIStream(memStream))) break;
+        } else {
+            if (FAILED(stream->InitializeFromFilename(path, GENERIC_WRITE))) break;
+        }
+        if (FAILED(factory->CreateEncoder(container, NULL, &encoder))) break;
+        if (FAILED(encoder->Initialize(stream, WICBitmapEncoderNoCache))) break;
+        if (FAILED(encoder->CreateNewFrame(&frame, &props))) break;
+
+        PROPBAG2 opt = {};
+        VARIANT v;
+        VariantInit(&v);
+        if (IsEqualGUID(container, GUID_ContainerFormatPng)) {
+            LONG level = g_compressionLevel;
+            opt.pstrName = const_cast<LPOLESTR>(L"FilterOption");
+            v.vt = VT_UI1;
+            v.bVal = (level == CompressionFast) ? WICPngFilterNone
+                   : (level == CompressionBest) ? WICPngFilterAdaptive
+                   : WICPngFilterUnspecified;
+            props->Write(1, &opt, &v);
+        } else if (IsEqualGUID(container, GUID_ContainerFormatJpeg)) {
+            opt.pstrName = const_cast<LPOLESTR>(L"ImageQuality");
+            v.vt = VT_R4;
+            v.fltVal = (float)g_jpegQuality / 100.0f;
+            props->Write(1, &opt, &v);
+        }
+
+        if (FAILED(frame->Initialize(props))) break;
+        if (FAILED(frame->SetSize(w, h))) break;
+        WICPixelFormatGUID want = GUID_WICPixelFormat32bppBGR;
+        WICPixelFormatGUID got = want;
+        if (FAILED(frame->SetPixelFormat(&got))) break;
+        if (IsEqualGUID(got, want)) {
+            if (FAILED(frame->WritePixels(h, stride, stride * h, pixels))) break;
+        } else if (IsEqualGUID(got, GUID_WICPixelFormat24bppBGR)) {
+            // JPEG negotiates 24bpp: convert with our own row kernel into
+            // the arena instead of spinning up a WIC bitmap and converter
+            // per frame
+            UINT bgrStride = (UINT)w * 3;
+            BYTE* bgr = (BYTE*)ArenaAlloc((SIZE_T)bgrStride * h);
+            if (!bgr) break;
+            for (int y = 0; y < h; ++y) {
+                ConvertRow<PixelBgra32, PixelBgr24>(pixels + (SIZE_T)y * stride,
+                                                    bgr + (SIZE_T)y * bgrStride, w);
+            }
+            if (FAILED(frame->WritePixels(h, bgrStride, bgrStride * h, bgr))) break;
+        } else {
+            // Encoder wants some other format: wrap the bits and let a WIC
+            // converter feed the frame
+            IWICBitmap* src = NULL;
+            IWICFormatConverter* conv = NULL;
+            HRESULT hr = factory->CreateBitmapFromMemory(w, h, want, stride,
+                                                         stride * h, pixels, &src);
+            if (SUCCEEDED(hr)) hr = factory->CreateFormatConverter(&conv);
+            if (SUCCEEDED(hr)) hr = conv->Initialize(src, got, WICBitmapDitherTypeNone,
+                                                     NULL, 0.0, WICBitmapPaletteTypeCustom);
+            if (SUCCEEDED(hr)) hr = frame->WriteSource(conv, NULL);
+            if (conv) conv->Release();
+            if (src) src->Release();
+            if (FAILED(hr)) break;
+        }
+        if (FAILED(frame->Commit())) break;
+        if (FAILED(encoder->Commit())) break;
+        ok = true;
+    } while (0);
+    if (props) props->Release();
+    if (frame) frame->Release();
+    if (encoder) encoder->Release();
+    if (stream) stream->Release();
+
+    if (memStream) {
+        HGLOBAL hg = NULL;
+        ULARGE_INTEGER end = {};
+        LARGE_INTEGER zero = {};
+        if (ok &&
+            SUCCEEDED(memStream->Seek(zero, STREAM_SEEK_END, &end)) &&
+            end.QuadPart > 0 && end.QuadPart < MAXDWORD &&
+            SUCCEEDED(GetHGlobalFromStream(memStream, &hg))) {
+            // fDeleteOnRelease was FALSE, so the HGLOBAL outlives the stream
+            // and QueueFileWrite owns it from here
+            memStream->Release();
+            QueueFileWrite(path, hg, (DWORD)end.QuadPart);
+        } else {
+            hg = NULL;
+            GetHGlobalFromStream(memStream, &hg);
+            memStream->Release();
+            if (hg) GlobalFree(hg);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool GetCachedPngClsid(CLSID* out) {
+    LONG state = g_pngClsidState;
+    if (state == 0) {
+        // Racing resolvers write the same value, so this needs no lock.
+        state = (GetEncoderClsid(L"image/png", &g_pngClsid) >= 0) ? 1 : -1;
+        InterlockedExchange(&g_pngClsidState, state);
+    }
+    if (state < 0) return false;
+    *out = g_pngClsid;
+    return true;
+}
+
+// Pushes an encoded buffer to its file: overlapped on the encoder thread,
+// synchronous otherwise. Takes ownership of hg.
+static void WriteEncodedBuffer(const WCHAR* path, HGLOBAL hg, DWORD size, bool asyncWrite) {
+    if (asyncWrite) {
+        QueueFileWrite(path, hg, size);
+        return;
+    }
+    void* bytes = GlobalLock(hg);
+    if (bytes) {
+        WriteBufferSync(path, bytes, size);
+        GlobalUnlock(hg);
+    }
+    GlobalFree(hg);
+}
+
+// Raw BMP dump: a file header plus the top-down 32bpp bits, no compression.
+static bool SaveBitmapAsBmp(const BYTE* pixels, int w, int h, UINT stride,
+                            const WCHAR* path, bool asyncWrite) {
+    DWORD rowBytes = (DWORD)w * 4;
+    DWORD imageBytes = rowBytes * h;
+    DWORD total = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + imageBytes;
+    HGLOBAL hg = GlobalAlloc(GMEM_MOVEABLE, total);
+    BYTE* out = hg ? (BYTE*)GlobalLock(hg) : NULL;
+    if (!out) {
+        if (hg) GlobalFree(hg);
+        return false;
+    }
+    BITMAPFILEHEADER* bfh = (BITMAPFILEHEADER*)out;
+    bfh->bfType = 0x4D42; // 'BM'
+    bfh->bfSize = total;
+    bfh->bfReserved1 = 0;
+    bfh->bfReserved2 = 0;
+    bfh->bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+    BITMAPINFOHEADER* bih = (BITMAPINFOHEADER*)(out + sizeof(BITMAPFILEHEADER));
+    memset(bih, 0, sizeof(*bih));
+    bih->biSize = sizeof(BITMAPINFOHEADER);
+    bih->biWidth = w;
+    bih->biHeight = -h; // top-down, matches the capture DIB layout
+    bih->biPlanes = 1;
+    bih->biBitCount = 32;
+    bih->biCompression = BI_RGB;
+    bih->biSizeImage = imageBytes;
+    BYTE* dst = out + bfh->bfOffBits;
+    for (int y = 0; y < h; ++y) {
+        memcpy(dst + (SIZE_T)y * rowBytes, pixels + (SIZE_T)y * stride, rowBytes);
+    }
+    GlobalUnlock(hg);
+    WriteEncodedBuffer(path, hg, total, asyncWrite);
+    return true;
+}
+
+// ---- QOI encoder ----
+// Fast-lossless path: the "Quite OK Image" format is a one-pass byte stream
+// of run/index/delta ops with no entropy stage, so it encodes at close to
+// memory bandwidth. Alpha is ignored (screen captures are opaque), the file
+// declares 3 channels.
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+
+static SIZE_T QoiEncode(const BYTE* bgra, int w, int h, UINT stride, BYTE* out) {
+    SIZE_T p = 0;
+    // 14-byte header: magic, big-endian dimensions, channels, colorspace
+    out[p++] = 'q'; out[p++] = 'o'; out[p++] = 'i'; out[p++] = 'f';
+    out[p++] = (BYTE)(w >> 24); out[p++] = (BYTE)(w >> 16);
+    out[p++] = (BYTE)(w >> 8);  out[p++] = (BYTE)w;
+    out[p++] = (BYTE)(h >> 24); out[p++] = (BYTE)(h >> 16);
+    out[p++] = (BYTE)(h >> 8);  out[p++] = (BYTE)h;
+    out[p++] = 3; // channels
+    out[p++] = 0; // sRGB with linear alpha
+
+    BYTE index[64][3] = {};
+    BYTE pr = 0, pg = 0, pb = 0; // previous pixel, spec-initial black
+    int run = 0;
+    for (int y = 0; y < h; ++y) {
+        const BYTE* row = bgra + (SIZE_T)y * stride;
+        for (int x = 0; x < w; ++x) {
+            BYTE b = row[x * 4 + 0];
+            BYTE g = row[x * 4 + 1];
+            BYTE r = row[x * 4 + 2];
+            if (r == pr && g == pg && b == pb) {
+                if (++run == 62) {
+                    out[p++] = (BYTE)(QOI_OP_RUN | (run - 1));
+                    run = 0;
+                }
+            } else {
+                if (run > 0) {
+                    out[p++] = (BYTE)(QOI_OP_RUN | (run - 1));
+                    run = 0;
+                }
+                int slot = (r * 3 + g * 5 + b * 7 + 255 * 11) & 63;
+                if (index[slot][0] == r && index[slot][1] == g && index[slot][2] == b) {
+                    out[p++] = (BYTE)(QOI_OP_INDEX | slot);
+                } else {
+                    index[slot][0] = r;
+                    index[slot][1] = g;
+                    index[slot][2] = b;
+                    signed char dr = (signed char)(r - pr);
+                    signed char dg = (signed char)(g - pg);
+                    signed char db = (signed char)(b - pb);
+                    signed char dgr = (signed char)(dr - dg);
+                    signed char dgb = (signed char)(db - dg);
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        out[p++] = (BYTE)(QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+                    } else if (dg >= -32 && dg <= 31 && dgr >= -8 && dgr <= 7 && dgb >= -8 && dgb <= 7) {
+                        out[p++] = (BYTE)(QOI_OP_LUMA | (dg + 32));
+                        out[p++] = (BYTE)(((dgr + 8) << 4) | (dgb + 8));
+                    } else {
+                        out[p++] = QOI_OP_RGB;
+                        out[p++] = r;
+                        out[p++] = g;
+                        out[p++] = b;
+                    }
+                }
+                pr = r; pg = g; pb = b;
+            }
+        }
+    }
+    if (run > 0) out[p++] = (BYTE)(QOI_OP_RUN | (run - 1));
+    // end marker
+    for (int i = 0; i < 7; ++i) out[p++] = 0;
+    out[p++] = 1;
+    return p;
+}
+
+static bool SaveBitmapAsQoi(const BYTE* pixels, int w, int h, UINT stride,
+                            const WCHAR* path, bool asyncWrite) {
+    // Worst case one QOI_OP_RGB (4 bytes) per pixel, plus header and marker
+    SIZE_T cap = (SIZE_T)w * h * 4 + 14 + 8;
+    if (cap > MAXDWORD) return false;
+    HGLOBAL hg = GlobalAlloc(GMEM_MOVEABLE, cap);
+    BYTE* out = hg ? (BYTE*)GlobalLock(hg) : NULL;
+    if (!out) {
+        if (hg) GlobalFree(hg);
+        return false;
+    }
+    SIZE_T size = QoiEncode(pixels, w, h, stride, out);
+    GlobalUnlock(hg);
+    WriteEncodedBuffer(path, hg, (DWORD)size, asyncWrite);
+    return true;
+}
+
+// ---- Band-parallel encoding ----
+// A single 4K frame compresses on one core while the rest idle. The .qot
+// container splits the frame into horizontal bands, each an independent QOI
+// stream, so bands compress (and later decode) in parallel. Layout: header
+// {"QOIT", version, w, h, bands, bandRows, DWORD size[bands]} followed by
+// the concatenated band streams; every band covers bandRows rows except the
+// last, which takes the remainder.
+
+struct QoiBandJob {
+    const BYTE* pixels; // first row of this band
+    int w;
+    int rows;
+    UINT stride;
+    BYTE* out;          // band's region of the shared output buffer
+    SIZE_T size;        // bytes produced
+};
+
+static DWORD WINAPI QoiBandProc(LPVOID param) {
+    QoiBandJob* job = (QoiBandJob*)param;
+    job->size = QoiEncode(job->pixels, job->w, job->rows, job->stride, job->out);
+    return 0;
+}
+
+static bool SaveBitmapAsQoiBanded(const BYTE* pixels, int w, int h, UINT stride,
+                                  const WCHAR* path, bool asyncWrite) {
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int bands = (int)si.dwNumberOfProcessors;
+    if (bands > 8) bands = 8;
+    if (bands > h / 16) bands = h / 16; // no point in slivers
+    if (bands < 1) bands = 1;
+    int bandRows = h / bands;
+
+    // Worst case one QOI_OP_RGB per pixel plus header and marker, per band
+    SIZE_T headerBytes = 24 + (SIZE_T)bands * sizeof(DWORD);
+    SIZE_T worstBand = (SIZE_T)w * (bandRows + h % bands) * 4 + 14 + 8;
+    SIZE_T cap = headerBytes + (SIZE_T)bands * worstBand;
+    if (cap > MAXDWORD) return false;
+    HGLOBAL hg = GlobalAlloc(GMEM_MOVEABLE, cap);
+    BYTE* out = hg ? (BYTE*)GlobalLock(hg) : NULL;
+    if (!out) {
+        if (hg) GlobalFree(hg);
+        return false;
+    }
+
+    // Encode every band into its own worst-case region, last band on this
+    // thread, the rest on transient workers.
+    QoiBandJob jobs[8];
+    HANDLE workers[7];
+    int workerCount = 0;
+    for (int b = 0; b < bands; ++b) {
+        jobs[b].pixels = pixels + (SIZE_T)b * bandRows * stride;
+        jobs[b].w = w;
+        jobs[b].rows = (b == bands - 1) ? h - b * bandRows : bandRows;
+        jobs[b].stride = stride;
+        jobs[b].out = out + headerBytes + (SIZE_T)b * worstBand;
+        jobs[b].size = 0;
+    }
+    for (int b = 0; b < bands - 1; ++b) {
+        HANDLE t = CreateThread(NULL, 0, QoiBandProc, &jobs[b], 0, NULL);
+        if (t) {
+            workers[workerCount++] = t;
+        } else {
+            QoiBandProc(&jobs[b]); // out of threads: encode inline
+        }
+    }
+    QoiBandProc(&jobs[bands - 1]);
+    if (workerCount > 0) {
+        WaitForMultipleObjects(workerCount, workers, TRUE, INFINITE);
+        for (int i = 0; i < workerCount; ++i) CloseHandle(workers[i]);
+    }
+
+    // Header, then compact the bands so the streams are contiguous
+    BYTE* p = out;
+    p[0] = 'Q'; p[1] = 'O'; p[2] = 'I'; p[3] = 'T';
+    DWORD* fields = (DWORD*)(p + 4);
+    fields[0] = 1;
+    fields[1] = (DWORD)w;
+    fields[2] = (DWORD)h;
+    fields[3] = (DWORD)bands;
+    fields[4] = (DWORD)bandRows;
+    DWORD* sizes = (DWORD*)(p + 24);
+    SIZE_T total = headerBytes;
+    for (int b = 0; b < bands; ++b) {
+        sizes[b] = (DWORD)jobs[b].size;
+        memmove(out + total, jobs[b].out, jobs[b].size);
+        total += jobs[b].size;
+    }
+    GlobalUnlock(hg);
+    WriteEncodedBuffer(path, hg, (DWORD)total, asyncWrite);
+    return true;
+}
+
+// Encodes and writes a capture in the configured output format. PNG and
+// JPEG go through WIC; BMP and QOI are written directly. Failures fall back
+// to PNG via GDI+ so a capture is never silently lost.
+static void SaveCaptureBitmapImpl(HBITMAP hBmp, const WCHAR* path, bool asyncWrite) {
+    LONG format = g_outputFormat;
+    if (format == FormatBmp || format == FormatQoi || format == FormatQoiBanded) {
+        int w, h;
+        UINT stride;
+        BYTE* pixels;
+        if (GetBitmapPixels(hBmp, &w, &h, &stride, &pixels)) {
+            bool ok;
+            if (format == FormatBmp) {
+                ok = SaveBitmapAsBmp(pixels, w, h, stride, path, asyncWrite);
+            } else if (format == FormatQoiBanded) {
+                ok = SaveBitmapAsQoiBanded(pixels, w, h, stride, path, asyncWrite);
+            } else {
+                ok = SaveBitmapAsQoi(pixels, w, h, stride, path, asyncWrite);
+            }
+            if (ok) return;
+        }
+    } else {
+        const GUID& container = (format == FormatJpeg)
+            ? GUID_ContainerFormatJpeg : GUID_ContainerFormatPng;
+        if (SaveBitmapWic(hBmp, path, asyncWrite, container)) return;
+    }
+    // GDI+ PNG fallback (always max-effort compression)
+    Bitmap bitmap(hBmp, NULL);
+    CLSID pngClsid;
+    if (GetCachedPngClsid(&pngClsid)) {
+        bitmap.Save(path, &pngClsid, NULL);
+    }
+}
+
+// Timed shell around the encoder. The write stage is timed separately at
+// the WriteFile call sites; since those run inside the encode pass, a
+// synchronous write shows up in both stages (encode = wall time per frame,
+// write = how much of it was file I/O).
+void SaveCaptureBitmap(HBITMAP hBmp, const WCHAR* path, bool asyncWrite) {
+    EnsureCaptureInit(); // covers the bench and any future direct callers
+    LONG64 t0 = StatClockStart();
+    SaveCaptureBitmapImpl(hBmp, path, asyncWrite);
+    StatClockStop(StageEncode, t0);
+}
+
+static DWORD WINAPI EncodeThreadProc(LPVOID) {
+    for (;;) {
+        WaitForSingleObject(g_encodeWake, INFINITE);
+        if (g_encodeStop) break;
+        LONG pos = g_encodeTail;
+        EncodeSlot* slot = &g_encodeQueue[pos & (ENCODE_QUEUE_CAPACITY - 1)];
+        // Spin briefly until the producer has published the slot contents
+        while (slot->sequence != pos + 1) {
+            YieldProcessor();
+        }
+        EncodeJob job = slot->job;
+        InterlockedExchange(&slot->sequence, pos + ENCODE_QUEUE_CAPACITY);
+        g_encodeTail = pos + 1;
+        SaveCaptureBitmap(job.hBmp, job.path, true);
+        DeleteObject(job.hBmp);
+        if (job.journal) {
+            job.journal->encodeUs = t_lastStageUs[StageEncode];
+            job.journal->writeUs = t_lastStageUs[StageWrite];
+            InterlockedExchange(&job.journal->committed, 1);
+        }
+        ArenaReset();
+    }
+    // Drain outstanding overlapped writes before exiting
+    while (g_writeHead) ReapCompletedWrites(true);
+    return 0;
+}
+
+static INIT_ONCE g_encodeInitOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK EncodeInitProc(PINIT_ONCE, PVOID, PVOID*) {
+    for (LONG i = 0; i < ENCODE_QUEUE_CAPACITY; ++i) {
+        g_encodeQueue[i].sequence = i;
+    }
+    g_encodeWake = CreateSemaphoreW(NULL, 0, ENCODE_QUEUE_CAPACITY, NULL);
+    if (g_encodeWake) {
+        g_encodeThread = CreateThread(NULL, 0, EncodeThreadProc, NULL, 0, NULL);
+        if (!g_encodeThread) {
+            CloseHandle(g_encodeWake);
+            g_encodeWake = NULL;
+        }
+    }
+    return TRUE;
+}
+
+// RecordScreen runs on every UI thread that wants the hook, so the queue
+// and its single consumer must come up exactly once — a plain flag check
+// here would let two racing threads re-seed live slot sequences and start
+// two consumers over the single-consumer tail.
+static void EnsureEncodeThread() {
+    InitOnceExecuteOnce(&g_encodeInitOnce, EncodeInitProc, NULL, NULL);
+}
+
+// Hands the bitmap to the encoder thread; on success the queue owns hBmp.
+// Returns false (caller saves synchronously) when full or not initialized.
+static bool QueueEncodeJob(HBITMAP hBmp, const WCHAR* path, JournalRecord* journal) {
+    if (!g_encodeThread || wcslen(path) >= MAX_PATH) return false;
+    for (;;) {
+        LONG pos = g_encodeHead;
+        EncodeSlot* slot = &g_encodeQueue[pos & (ENCODE_QUEUE_CAPACITY - 1)];
+        LONG seq = slot->sequence;
+        if (seq == pos) {
+            if (InterlockedCompareExchange(&g_encodeHead, pos + 1, pos) == pos) {
+                slot->job.hBmp = hBmp;
+                slot->job.journal = journal;
+                wcscpy_s(slot->job.path, path);
+                InterlockedExchange(&slot->sequence, pos + 1);
+                ReleaseSemaphore(g_encodeWake, 1, NULL);
+                return true;
+            }
+        } else if (seq < pos) {
+            return false; // full
+        }
+        // another producer claimed the slot; retry
+    }
+}
+
+// Reserve the output name on disk before queuing so NextUniquePath never
+// hands the same name to two captures that are both still in the queue.
+// Returns false only when the file already exists (index out of date, e.g.
+// an external writer dropped files into the directory).
+static bool ReserveOutputFile(const WCHAR* path) {
+    HANDLE h = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_NEW,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h != INVALID_HANDLE_VALUE) {
+        CloseHandle(h);
+        return true;
+    }
+    return GetLastError() != ERROR_FILE_EXISTS;
+}
+
+// ---- Retained capture ring ----
+// "Capture now, save later": when retainedFrames > 0 each capture's DIB goes
+// into a fixed ring instead of the encode queue, so an F11 press costs only
+// the grab. FlushCaptures() encodes and writes whatever is still in the
+// ring; when the ring wraps, the oldest frame is discarded unencoded. The
+// DIB sections themselves are the frame pool, so retaining adds no copies.
+#define RETAIN_RING_MAX 64
+
+struct RetainedFrame {
+    HBITMAP bmp;
+    WCHAR base[MAX_PATH]; // name resolved while the window still existed
+};
+
+static RetainedFrame g_retainRing[RETAIN_RING_MAX];
+static int g_retainHead = 0; // next slot to write
+static int g_retainCount = 0;
+static SRWLOCK g_retainLock = SRWLOCK_INIT;
+static volatile LONG g_retainFrames = 0; // ring size; 0 = retained mode off
+
+// Drops every retained frame; called when the ring is resized.
+static void ClearRetainRing() {
+    AcquireSRWLockExclusive(&g_retainLock);
+    for (int i = 0; i < RETAIN_RING_MAX; ++i) {
+        if (g_retainRing[i].bmp) {
+            DeleteObject(g_retainRing[i].bmp);
+            g_retainRing[i].bmp = NULL;
+        }
+    }
+    g_retainHead = 0;
+    g_retainCount = 0;
+    ReleaseSRWLockExclusive(&g_retainLock);
+}
+
+// Takes ownership of hBmp when retained mode is on; returns false otherwise.
+static bool RetainCapture(HBITMAP hBmp, const WCHAR* base) {
+    LONG size = g_retainFrames;
+    if (size <= 0) return false;
+    if (size > RETAIN_RING_MAX) size = RETAIN_RING_MAX;
+    AcquireSRWLockExclusive(&g_retainLock);
+    RetainedFrame* f = &g_retainRing[g_retainHead];
+    if (f->bmp) DeleteObject(f->bmp); // ring full: oldest frame falls off
+    f->bmp = hBmp;
+    wcscpy_s(f->base, base);
+    g_retainHead = (g_retainHead + 1) % size;
+    if (g_retainCount < size) g_retainCount++;
+    ReleaseSRWLockExclusive(&g_retainLock);
+    return true;
+}
+
+// ---- Scale-on-capture ----
+// Optional downscale stage between the grab and the encode: when
+// maxOutputWidth is set, frames wider than it are box-filtered down before
+// they ever reach the encoder, so a quarter-size frame costs a quarter of
+// the encode time and bytes instead of being shrunk later by a decode +
+// re-encode round trip.
+volatile LONG g_maxOutputWidth = 0; // 0 = encode at capture size
+
+// Per-thread accumulator for one row of vertical box sums, grow-only like
+// the other scratch buffers.
+static thread_local UINT16* t_scaleAcc = NULL;
+static thread_local int t_scaleAccCap = 0;
+
+// Thread-detach cleanup, same deal as ArenaRelease: the batch/burst workers
+// are short-lived and their accumulator would otherwise leak per exit.
+static void ScaleAccRelease() {
+    free(t_scaleAcc);
+    t_scaleAcc = NULL;
+    t_scaleAccCap = 0;
+}
+
+// Separable box filter over a top-down 32bpp DIB. The vertical pass (the
+// bulk of the work: every source pixel is touched) widens bytes to words
+// and sums contributing rows with SSE2; the horizontal pass then averages
+// the word sums per destination pixel in 32-bit scalar math, so there is no
+// limit on the scale ratio. Returns a new DIB at most maxW wide, or NULL
+// when no scaling applies (caller keeps the original).
+HBITMAP DownscaleFrame(HBITMAP src) {
+    LONG maxW = g_maxOutputWidth;
+    if (maxW <= 0) return NULL;
+    DIBSECTION ds;
+    if (GetObject(src, sizeof(ds), &ds) != sizeof(ds) || !ds.dsBm.bmBits) return NULL;
+    if (ds.dsBm.bmBitsPixel != 32 || ds.dsBmih.biHeight >= 0) return NULL;
+    int sw = ds.dsBm.bmWidth;
+    int sh = ds.dsBm.bmHeight;
+    if (sw <= maxW) return NULL;
+    int dw = maxW;
+    int dh = MulDiv(sh, dw, sw);
+    if (dh < 1) dh = 1;
+    // Word accumulators hold up to 257 summed rows; past a 256:1 ratio keep
+    // the original rather than overflow.
+    if (sw / dw > 256) return NULL;
+
+    int accLen = sw * 4;
+    if (accLen > t_scaleAccCap) {
+        free(t_scaleAcc);
+        t_scaleAcc = (UINT16*)malloc((SIZE_T)accLen * sizeof(UINT16));
+        t_scaleAccCap = t_scaleAcc ? accLen : 0;
+    }
+    if (!t_scaleAcc) return NULL;
+
+    void* dstBits = NULL;
+    HBITMAP out = CreateCaptureDib(dw, dh, &dstBits);
+    if (!out) return NULL;
+
+    const BYTE* srcBase = (const BYTE*)ds.dsBm.bmBits;
+    const int srcStride = ds.dsBm.bmWidthBytes;
+    UINT16* acc = t_scaleAcc;
+    const __m128i zero = _mm_setzero_si128();
+
+    for (int y = 0; y < dh; ++y) {
+        int y0 = MulDiv(y, sh, dh);
+        int y1 = MulDiv(y + 1, sh, dh);
+        if (y1 <= y0) y1 = y0 + 1;
+
+        // Vertical pass: widen the first row, then add the rest.
+        const BYTE* row = srcBase + (SIZE_T)y0 * srcStride;
+        int i = 0;
+        for (; i + 16 <= accLen; i += 16) {
+            __m128i px = _mm_loadu_si128((const __m128i*)(row + i));
+            _mm_storeu_si128((__m128i*)(acc + i), _mm_unpacklo_epi8(px, zero));
+            _mm_storeu_si128((__m128i*)(acc + i + 8), _mm_unpackhi_epi8(px, zero));
+        }
+        for (; i < accLen; ++i) acc[i] = row[i];
+        for (int yy = y0 + 1; yy < y1; ++yy) {
+            row = srcBase + (SIZE_T)yy * srcStride;
+            i = 0;
+            for (; i + 16 <= accLen; i += 16) {
+                __m128i px = _mm_loadu_si128((const __m128i*)(row + i));
+                __m128i lo = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(acc + i)),
+                                           _mm_unpacklo_epi8(px, zero));
+                __m128i hi = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(acc + i + 8)),
+                                           _mm_unpackhi_epi8(px, zero));
+                _mm_storeu_si128((__m128i*)(acc + i), lo);
+                _mm_storeu_si128((__m128i*)(acc + i + 8), hi);
+            }
+            for (; i < accLen; ++i) acc[i] = (UINT16)(acc[i] + row[i]);
+        }
+
+        // Horizontal pass: average each destination pixel's source span.
+        ShrinkAccRow<PixelBgra32>(acc, sw, dw, (UINT32)(y1 - y0),
+                                  (BYTE*)dstBits + (SIZE_T)y * dw * 4);
+    }
+    return out;
+}
+
+// ---- Duplicate-frame suppression ----
+// Soak runs produce thousands of identical screenshots of an unchanged
+// window. When dedupe is on, each finished frame is content-hashed before
+// naming and compared against the last kept capture of the same window; a
+// match skips encode, save, and the -N suffix entirely and only bumps the
+// duplicatesSkipped stat. The hash is xxHash32-style — four rotating
+// 32-bit lanes — and runs at memory speed, ~1ms for a 4K frame.
+
+static volatile LONG g_dedupeFrames = 0; // 0 = keep every capture
+
+#define DEDUPE_SLOTS 16
+
+struct DedupeEntry {
+    HWND hwnd;
+    DWORD hash;
+};
+
+static DedupeEntry g_dedupeTable[DEDUPE_SLOTS];
+static int g_dedupeEvict = 0; // round-robin replacement cursor
+static SRWLOCK g_dedupeLock = SRWLOCK_INIT;
+
+// True when the frame's content matches the last kept capture of hwnd;
+// otherwise records the new hash and returns false.
+static bool IsDuplicateFrame(HWND hwnd, HBITMAP hBmp) {
+    int w, h;
+    UINT stride;
+    BYTE* pixels;
+    if (!GetBitmapPixels(hBmp, &w, &h, &stride, &pixels)) {
+        return false;
+    }
+    // Chain per-row hashes so stride padding never enters the digest
+    DWORD hash = XXH_PRIME5 ^ ((DWORD)w << 16) ^ (DWORD)h;
+    for (int y = 0; y < h; ++y) {
+        hash = HashRowPixels<PixelBgra32>(pixels + (SIZE_T)y * stride, w, hash);
+    }
+
+    bool duplicate = false;
+    AcquireSRWLockExclusive(&g_dedupeLock);
+    int found = -1;
+    for (int i = 0; i < DEDUPE_SLOTS; ++i) {
+        if (g_dedupeTable[i].hwnd == hwnd) { found = i; break; }
+    }
+    if (found >= 0) {
+        duplicate = (g_dedupeTable[found].hash == hash);
+        g_dedupeTable[found].hash = hash;
+    } else {
+        g_dedupeTable[g_dedupeEvict].hwnd = hwnd;
+        g_dedupeTable[g_dedupeEvict].hash = hash;
+        g_dedupeEvict = (g_dedupeEvict + 1) % DEDUPE_SLOTS;
+    }
+    ReleaseSRWLockExclusive(&g_dedupeLock);
+    return duplicate;
+}
+
+// ---- Backpressure governor ----
+// Async encode, burst, and batch mode all let captures queue; on a slow
+// disk or a CPU-starved box the encode queue and the in-flight write
+// memory would otherwise grow without bound, and on a 32-bit host that
+// ends in OOM. The governor watches both signals at every submit and
+// steps quality down one notch at a time — PNG filtering off, then
+// fast-lossless QOI, then downscale, then drop duplicate frames — and
+// steps back up once pressure has stayed clear. Degraded captures beat a
+// hung host. The current level and every transition land in the stats
+// block.
+
+#define GOVERN_STEPS 4
+
+static volatile LONG g_governEnabled = 1;
+static volatile LONG g_governQueueHi = ENCODE_QUEUE_CAPACITY / 2;
+static volatile LONG g_governMemHiMb = 64;
+static SRWLOCK g_governLock = SRWLOCK_INIT;
+static LONG g_governLevel = 0;     // current step, under g_governLock
+static DWORD g_governLastStep = 0; // tick of the last transition
+// Knob values the host asked for, captured before the first step down
+static LONG g_governBaseLevel, g_governBaseFormat;
+static LONG g_governBaseWidth, g_governBaseDedupe;
+
+static void GovernApply(LONG level) {
+    LONG cmp = (level >= 1) ? CompressionFast : g_governBaseLevel;
+    LONG fmt = g_governBaseFormat;
+    if (level >= 2 && (fmt == FormatPng || fmt == FormatJpeg)) fmt = FormatQoi;
+    LONG width = g_governBaseWidth;
+    if (level >= 3 && (width == 0 || width > 1280)) width = 1280;
+    LONG dedupe = (level >= 4) ? 1 : g_governBaseDedupe;
+    InterlockedExchange(&g_compressionLevel, cmp);
+    InterlockedExchange(&g_outputFormat, fmt);
+    InterlockedExchange(&g_maxOutputWidth, width);
+    InterlockedExchange(&g_dedupeFrames, dedupe);
+}
+
+// Evaluated once per submitted capture, on the producer side so the knobs
+// it moves (downscale, dedupe) take effect for this very frame.
+static void GovernUpdate() {
+    if (!g_governEnabled) return;
+    LONG depth = g_encodeHead - g_encodeTail;
+    // g_writeInFlight belongs to the encoder thread; a stale read just
+    // delays a transition by one capture
+    LONG inFlightMb = (LONG)(g_writeInFlight >> 20);
+    bool pressure = depth >= g_governQueueHi || inFlightMb >= g_governMemHiMb;
+
+    if (!TryAcquireSRWLockExclusive(&g_governLock)) return;
+    DWORD now = GetTickCount();
+    LONG step = 0;
+    if (pressure && g_governLevel < GOVERN_STEPS && now - g_governLastStep >= 250) {
+        if (g_governLevel == 0) {
+            g_governBaseLevel = g_compressionLevel;
+            g_governBaseFormat = g_outputFormat;
+            g_governBaseWidth = g_maxOutputWidth;
+            g_governBaseDedupe = g_dedupeFrames;
+        }
+        step = 1;
+    } else if (!pressure && g_governLevel > 0 && now - g_governLastStep >= 2000) {
+        step = -1;
+    }
+    if (step != 0) {
+        g_governLevel += step;
+        g_governLastStep = now;
+        GovernApply(g_governLevel);
+        CaptureStats* stats = GetStatsBlock();
+        InterlockedExchange(&stats->governorLevel, g_governLevel);
+        InterlockedIncrement64(&stats->governorTransitions);
+    }
+    ReleaseSRWLockExclusive(&g_governLock);
+}
+
+// RecordScreenEx may move the knobs while the governor is degraded; the
+// freshly-written values become the new baseline and the current step
+// re-applies on top, so they are not lost when pressure clears.
+static void GovernRebase() {
+    AcquireSRWLockExclusive(&g_governLock);
+    if (g_governLevel > 0) {
+        g_governBaseLevel = g_compressionLevel;
+        g_governBaseFormat = g_outputFormat;
+        g_governBaseWidth = g_maxOutputWidth;
+        g_governBaseDedupe = g_dedupeFrames;
+        GovernApply(g_governLevel);
+    }
+    ReleaseSRWLockExclusive(&g_governLock);
+}
+
+// Batch workers save on their own thread instead of handing frames to the
+// shared encoder queue — they are the pool.
+static thread_local bool t_encodeInline = false;
+
+// Names, reserves, and queues a finished frame. Takes ownership of hBmp.
+static void SubmitNamedCapture(HBITMAP hBmp, const WCHAR* base) {
+    WCHAR path[MAX_PATH];
+    bool reserved = false;
+    for (int attempt = 0; attempt < 8 && !reserved; ++attempt) {
+        NextUniquePath(base, path, MAX_PATH);
+        reserved = ReserveOutputFile(path);
+    }
+    if (!reserved) {
+        // Eight straight collisions means something besides the index is
+        // minting these names; dropping the frame beats opening an existing
+        // capture with CREATE_ALWAYS and destroying it.
+        DeleteObject(hBmp);
+        ArenaReset();
+        return;
+    }
+    // Journal the capture: grab-side fields now, encoder-side fields when
+    // the encode lands (the record commits there).
+    JournalRecord* journal = JournalClaim();
+    if (journal) {
+        const WCHAR* name = wcsrchr(base, L'\\');
+        name = name ? name + 1 : base;
+        const WCHAR* fileName = wcsrchr(path, L'\\');
+        fileName = fileName ? fileName + 1 : path;
+        BITMAP bm = {};
+        GetObjectW(hBmp, sizeof(bm), &bm);
+        journal->committed = 0;
+        journal->titleHash = FnvHashW(name);
+        journal->tickMs = GetTickCount();
+        journal->width = (DWORD)bm.bmWidth;
+        journal->height = (DWORD)(bm.bmHeight < 0 ? -bm.bmHeight : bm.bmHeight);
+        journal->blitUs = t_lastStageUs[StageBlit];
+        journal->printUs = t_lastStageUs[StagePrintWindow];
+        journal->encodeUs = 0;
+        journal->writeUs = 0;
+        wcsncpy_s(journal->fileName, fileName, _TRUNCATE);
+    }
+    if (t_encodeInline || !QueueEncodeJob(hBmp, path, journal)) {
+        SaveCaptureBitmap(hBmp, path, false);
+        DeleteObject(hBmp);
+        if (journal) {
+            journal->encodeUs = t_lastStageUs[StageEncode];
+            journal->writeUs = t_lastStageUs[StageWrite];
+            InterlockedExchange(&journal->committed, 1);
+        }
+    }
+    ArenaReset();
+}
+
+// ---- Window metadata snapshot ----
+// A capture used to issue a dozen-plus USER32/DWM queries — window rect,
+// styles, extended bounds, client rect and origin, title, class — several
+// repeated for the same HWND across CaptureWindow, GetWindowRoi, and
+// BuildBaseName. Each can block on the target thread's message queue
+// (cross-thread window queries synchronize with it), so they are
+// consolidated into one snapshot taken at the top of the capture and
+// passed down. Burst workers additionally cache the snapshot per HWND for
+// a short TTL, so repeat frames of the same window skip the queries
+// entirely; a window dragged mid-burst just means the rect is up to
+// META_TTL_MS stale.
+
+struct WindowMeta {
+    HWND hwnd;
+    RECT rcWin;       // GetWindowRect
+    RECT rcExt;       // extended frame bounds; == rcWin when DWM declines
+    RECT rcClient;    // client size, origin (0,0)
+    POINT ptClient;   // client origin in screen coordinates
+    LONG_PTR style;
+    LONG_PTR exstyle;
+    WCHAR title[256]; // window text; empty when the window has none
+    WCHAR cls[64];
+};
+
+#define META_TTL_MS 200
+static thread_local WindowMeta t_metaCache;
+static thread_local DWORD t_metaCacheTick = 0;
+static thread_local bool t_metaCacheOn = false; // burst workers only
+
+static bool SnapshotWindowMeta(HWND hwnd, WindowMeta* out) {
+    if (t_metaCacheOn && t_metaCache.hwnd == hwnd &&
+        GetTickCount() - t_metaCacheTick < META_TTL_MS) {
+        *out = t_metaCache;
+        return true;
+    }
+    if (!IsWindow(hwnd)) return false;
+    out->hwnd = hwnd;
+    if (!GetWindowRect(hwnd, &out->rcWin)) return false;
+    out->style = GetWindowLongPtr(hwnd, GWL_STYLE);
+    out->exstyle = GetWindowLongPtr(hwnd, GWL_EXSTYLE);
+    // For child/MDI child windows, prefer the raw window rect; DWM extended
+    // bounds can be relative or misaligned for those
+    out->rcExt = out->rcWin;
+    if (!(out->style & WS_CHILD) && !(out->exstyle & WS_EX_MDICHILD)) {
+        RECT rex = out->rcWin;
+        if (SUCCEEDED(DwmGetWindowAttribute(hwnd, DWMWA_EXTENDED_FRAME_BOUNDS,
+                                            &rex, sizeof(rex)))) {
+            out->rcExt = rex;
+        }
+    }
+    SetRectEmpty(&out->rcClient);
+    GetClientRect(hwnd, &out->rcClient);
+    out->ptClient.x = 0;
+    out->ptClient.y = 0;
+    ClientToScreen(hwnd, &out->ptClient);
+    out->title[0] = 0;
+    GetWindowTextW(hwnd, out->title, _countof(out->title));
+    out->cls[0] = 0;
+    GetClassNameW(hwnd, out->cls, _countof(out->cls));
+    if (t_metaCacheOn) {
+        t_metaCache = *out;
+        t_metaCacheTick = GetTickCount();
+    }
+    return true;
+}
+
+// Common tail of every capture: unique name, reserve it, queue the encode
+// (or park the frame in the retained ring). Takes ownership of hBmp. The
+// whole naming pass runs in fixed stack buffers; no heap allocation on the
+// hooked thread.
+static void SubmitCapture(HBITMAP hBmp, const WindowMeta& meta) {
+    GovernUpdate();
+    // The encoder reads the DIB bits directly on another thread; make sure
+    // this thread's batched GDI drawing has landed first.
+    GdiFlush();
+    HBITMAP scaled = DownscaleFrame(hBmp);
+    if (scaled) {
+        DeleteObject(hBmp);
+        hBmp = scaled;
+    }
+    if (g_dedupeFrames && IsDuplicateFrame(meta.hwnd, hBmp)) {
+        DeleteObject(hBmp);
+        InterlockedIncrement64(&GetStatsBlock()->duplicatesSkipped);
+        ArenaReset();
+        return;
+    }
+    WCHAR base[MAX_PATH];
+    if (!BuildBaseName(meta, base, MAX_PATH)) {
+        DeleteObject(hBmp);
+        ArenaReset();
+        return;
+    }
+    if (RetainCapture(hBmp, base)) return;
+    SubmitNamedCapture(hBmp, base);
+}
+
+// ---- Per-thread capture context ----
+// Pools the GDI objects every capture needs so burst workloads stop churning
+// handles: two reusable memory DCs (one for the output bitmap, one for
+// staging sources) and a grow-only top-down 32bpp scratch DIB section sized
+// to the largest window seen on this thread. Output bitmaps are still
+// allocated per capture because their ownership passes to the encoder
+// thread; everything transient is pooled here.
+// All capture output is allocated as a top-down 32bpp DIB section rather
+// than a compatible bitmap: the encoder reads the mapped bits directly, so
+// GDI+/WIC never has to make a full-frame copy of a DDB first.
+HBITMAP CreateCaptureDib(int w, int h, void** bits) {
+    if (bits) *bits = NULL;
+    if (w <= 0 || h <= 0) return NULL;
+    BITMAPINFO bmi = {};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = w;
+    bmi.bmiHeader.biHeight = -h; // top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    void* p = NULL;
+    HBITMAP bmp = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, &p, NULL, 0);
+    if (bmp && bits) *bits = p;
+    return bmp;
+}
+
+struct CaptureContext {
+    HDC outDC = NULL;          // output bitmap selected here during a capture
+    HDC srcDC = NULL;          // staging/source bitmap selection
+    HBITMAP scratchBmp = NULL; // grow-only scratch DIB section
+    void* scratchBits = NULL;
+    int scratchW = 0;
+    int scratchH = 0;
+
+    ~CaptureContext() {
+        if (scratchBmp) DeleteObject(scratchBmp);
+        if (srcDC) DeleteDC(srcDC);
+        if (outDC) DeleteDC(outDC);
+    }
+};
+
+static CaptureContext* GetCaptureContext() {
+    static thread_local CaptureContext ctx;
+    if (!ctx.outDC) ctx.outDC = CreateCompatibleDC(NULL);
+    if (!ctx.srcDC) ctx.srcDC = CreateCompatibleDC(NULL);
+    if (!ctx.outDC || !ctx.srcDC) return NULL;
+    return &ctx;
+}
+
+// Returns the scratch DIB, at least w x h pixels; reallocates only on growth.
+static HBITMAP AcquireScratchBitmap(CaptureContext* ctx, int w, int h) {
+    if (w <= 0 || h <= 0) return NULL;
+    if (w > ctx->scratchW || h > ctx->scratchH) {
+        int newW = max(w, ctx->scratchW);
+        int newH = max(h, ctx->scratchH);
+        void* bits = NULL;
+        HBITMAP bmp = CreateCaptureDib(newW, newH, &bits);
+        if (!bmp) return NULL;
+        if (ctx->scratchBmp) DeleteObject(ctx->scratchBmp);
+        ctx->scratchBmp = bmp;
+        ctx->scratchBits = bits;
+        ctx->scratchW = newW;
+        ctx->scratchH = newH;
+    }
+    return ctx->scratchBmp;
+}
+
+// Builds "<dir>\<sanitized title>" (no extension) into a caller-provided
+// buffer. One pass, fixed buffers, no heap traffic: naming runs on the
+// hooked UI thread. Long names are truncated rather than failed. Title and
+// class come from the capture's metadata snapshot, not fresh USER32 calls.
+static bool BuildBaseName(const WindowMeta& meta, WCHAR* out, size_t cap) {
+    WCHAR title[256] = {0};
+    wcsncpy_s(title, meta.title[0] ? meta.title : meta.cls, _TRUNCATE);
+    // Remove/normalize characters: illegal -> '_', spaces -> '_', lowercase all
+    for (WCHAR* p = title; *p; ++p) {
+        WCHAR ch = *p;
+        if (ch == L'/' || ch == L'\\' || ch == L':' || ch == L'*' || ch == L'?' || ch == L'"' || ch == L'<' || ch == L'>' || ch == L'|' || ch == L' ') {
+            *p = L'_';
+        } else {
+            *p = (WCHAR)towlower(ch);
+        }
+    }
+    if (!title[0]) {
+        wcscpy_s(title, L"window"); // fallback generic name
+    }
+    // The base path is thread-local: set by RecordScreen on UI threads and
+    // inherited from the starting thread by burst workers.
+    size_t dirLen = wcslen(t_basePath);
+    if (dirLen == 0 || dirLen + 1 >= cap) return false;
+    wcsncpy_s(out, cap, t_basePath, _TRUNCATE);
+    size_t len = wcslen(out);
+    if (len > 0 && out[len - 1] != L'\\' && len + 1 < cap) {
+        out[len++] = L'\\';
+        out[len] = 0;
+    }
+    wcsncat_s(out, cap, title, _TRUNCATE);
+    return true;
+}
+
+// ---- Output name index ----
+// Maps each sanitized base name to the next free -N suffix, seeded by one
+// directory enumeration when the base path is set. Uniquing a name is then a
+// map lookup instead of a PathFileExistsW syscall per candidate, which
+// matters once a soak run has piled up hundreds of -N duplicates.
+static std::map<std::wstring, int> g_nameIndex; // full path sans ".png" -> next suffix
+static SRWLOCK g_nameIndexLock = SRWLOCK_INIT;
+static bool g_nameIndexSeeded = false;
+
+static void SeedNameIndex(const std::wstring& dir) {
+    std::wstring pattern = dir;
+    if (!pattern.empty() && pattern.back() != L'\\') pattern += L'\\';
+    std::wstring prefix = pattern; // directory with trailing backslash
+    pattern += L"*.*";
+
+    // Merge, never clear: keys are full paths, so entries for other output
+    // directories (each UI thread can register its own) stay live, and
+    // re-seeding the same directory is safe because the counters below only
+    // ever move forward.
+    AcquireSRWLockExclusive(&g_nameIndexLock);
+    WIN32_FIND_DATAW fd;
+    HANDLE h = FindFirstFileW(pattern.c_str(), &fd);
+    if (h != INVALID_HANDLE_VALUE) {
+        do {
+            std::wstring name = fd.cFileName;
+            size_t dot = name.find_last_of(L'.');
+            if (dot == std::wstring::npos || dot == 0) continue;
+            name.resize(dot); // strip the extension; all formats share the index
+            // Split a trailing "-N" back off so main_window-12 counts
+            // against main_window
+            int idx = 0;
+            size_t dash = name.find_last_of(L'-');
+            if (dash != std::wstring::npos && dash + 1 < name.size()) {
+                bool numeric = true;
+                for (size_t i = dash + 1; i < name.size(); ++i) {
+                    if (!iswdigit(name[i])) { numeric = false; break; }
+                }
+                if (numeric) {
+                    idx = _wtoi(name.c_str() + dash + 1);
+                    name.resize(dash);
+                }
+            }
+            int& next = g_nameIndex[prefix + name];
+            if (idx + 1 > next) next = idx + 1;
+        } while (FindNextFileW(h, &fd));
+        FindClose(h);
+    }
+    g_nameIndexSeeded = true;
+    ReleaseSRWLockExclusive(&g_nameIndexLock);
+}
+
+// Formats the next unique path for the given base into a caller-provided
+// buffer. Steady state is one map lookup plus one _snwprintf_s; the map key
+// is a reused thread-local string, so only the first capture of a new window
+// title ever allocates.
+static void NextUniquePath(const WCHAR* base, WCHAR* out, size_t cap) {
+    static thread_local std::wstring t_nameKey;
+    const WCHAR* ext = FormatExtension();
+
+    AcquireSRWLockExclusive(&g_nameIndexLock);
+    bool seeded = g_nameIndexSeeded;
+    int idx = 0;
+    if (seeded) {
+        t_nameKey.assign(base);
+        int& next = g_nameIndex[t_nameKey];
+        idx = next++;
+    }
+    ReleaseSRWLockExclusive(&g_nameIndexLock);
+
+    if (seeded) {
+        if (idx == 0) {
+            _snwprintf_s(out, cap, _TRUNCATE, L"%s%s", base, ext);
+        } else {
+            _snwprintf_s(out, cap, _TRUNCATE, L"%s-%d%s", base, idx, ext);
+        }
+        return;
+    }
+
+    // Index not seeded (base path never set through RecordScreen): fall back
+    // to probing the filesystem.
+    for (idx = 0;; ++idx) {
+        if (idx == 0) {
+            _snwprintf_s(out, cap, _TRUNCATE, L"%s%s", base, ext);
+        } else {
+            _snwprintf_s(out, cap, _TRUNCATE, L"%s-%d%s", base, idx, ext);
+        }
+        if (!PathFileExistsW(out)) return;
+    }
+}
+
+// ---- Region-of-interest capture ----
+// A registered ROI maps a window class to a client-coordinate sub-rect
+// (e.g. one status panel of a maximized 4K window). Captures of matching
+// windows grab only that rect from the screen — the DIB and the blit are
+// ROI-sized from the start rather than cropped after a full-frame copy, so
+// small captures cost proportionally small time. PrintWindow is skipped on
+// ROI captures; it can only render the whole client area.
+
+#define ROI_SLOTS 8
+
+struct RoiEntry {
+    WCHAR cls[64]; // window class name
+    RECT rc;       // client coordinates
+};
+
+static RoiEntry g_roiTable[ROI_SLOTS];
+static volatile LONG g_roiCount = 0;
+static SRWLOCK g_roiLock = SRWLOCK_INIT;
+
+// Registers (or clears, when the rect is empty) the ROI for a window class.
+static void SetWindowRoi(const char* clsUtf8, const RECT& rc) {
+    WCHAR cls[64];
+    if (!clsUtf8 || !MultiByteToWideChar(CP_UTF8, 0, clsUtf8, -1, cls, _countof(cls))) {
+        return;
+    }
+    bool clear = IsRectEmpty(&rc) != FALSE;
+    AcquireSRWLockExclusive(&g_roiLock);
+    int found = -1;
+    for (int i = 0; i < g_roiCount; ++i) {
+        if (_wcsicmp(g_roiTable[i].cls, cls) == 0) { found = i; break; }
+    }
+    if (clear) {
+        if (found >= 0) g_roiTable[found] = g_roiTable[--g_roiCount];
+    } else if (found >= 0) {
+        g_roiTable[found].rc = rc;
+    } else if (g_roiCount < ROI_SLOTS) {
+        wcscpy_s(g_roiTable[g_roiCount].cls, cls);
+        g_roiTable[g_roiCount].rc = rc;
+        g_roiCount++; // publish after the entry is complete
+    }
+    ReleaseSRWLockExclusive(&g_roiLock);
+}
+
+// Resolves the registered ROI for the window's class into a screen rect
+// clipped to the current client area. The unlocked count check keeps the
+// common no-ROI case free of the table scan and the lock; class, client
+// rect, and client origin all come from the metadata snapshot.
+static bool GetWindowRoi(const WindowMeta& meta, RECT* out) {
+    if (g_roiCount == 0) return false;
+    RECT roi;
+    bool found = false;
+    AcquireSRWLockShared(&g_roiLock);
+    for (int i = 0; i < g_roiCount; ++i) {
+        if (_wcsicmp(g_roiTable[i].cls, meta.cls) == 0) {
+            roi = g_roiTable[i].rc;
+            found = true;
+            break;
+        }
+    }
+    ReleaseSRWLockShared(&g_roiLock);
+    if (!found) return false;
+    RECT clipped;
+    if (!IntersectRect(&clipped, &roi, &meta.rcClient)) return false;
+    out->left = meta.ptClient.x + clipped.left;
+    out->top = meta.ptClient.y + clipped.top;
+    out->right = out->left + (clipped.right - clipped.left);
+    out->bottom = out->top + (clipped.bottom - clipped.top);
+    return true;
+}
+
+// ---- Bounded PrintWindow ----
+// PW_CLIENTONLY synchronously sends WM_PRINT into the target, and a busy
+// target (the host's main window mid-computation) can hold that send for
+// seconds — with the old inline call the capture, and the hooked UI
+// thread with it, blocked for the duration. The refinement now runs on a
+// worker with a deadline: the screen seed is already in the output bitmap,
+// so when the deadline passes the capture ships as-is and the worker's
+// late result is discarded. Worst-case capture latency is the timeout.
+static volatile LONG g_printTimeoutMs = 250; // 0 = inline, unbounded (old behavior)
+
+struct PrintWindowJob {
+    HWND hwnd;
+    HDC dc;           // memory DC owned by the job
+    HBITMAP bmp;      // top-down DIB the refinement prints into
+    HBITMAP oldBmp;
+    BOOL printed;
+    volatile LONG state; // 0 running, 1 done, 2 abandoned by the capturer
+};
+
+static DWORD WINAPI PrintWindowProc(LPVOID param) {
+    PrintWindowJob* job = (PrintWindowJob*)param;
+    job->printed = PrintWindow(job->hwnd, job->dc, PW_CLIENTONLY);
+    GdiFlush(); // land the print before the capturer blits from the bitmap
+    if (InterlockedCompareExchange(&job->state, 1, 0) == 2) {
+        // The capturer gave up and shipped the seed; clean up after ourselves
+        SelectObject(job->dc, job->oldBmp);
+        DeleteDC(job->dc);
+        DeleteObject(job->bmp);
+        free(job);
+    }
+    return 0;
+}
+
+// Overlays the client area via PrintWindow, honoring g_printTimeoutMs.
+// Sent messages are pumped while waiting (as in CaptureWindowUnion) so a
+// target living on this very thread can still answer its WM_PRINT.
+static void OverlayPrintWindow(CaptureContext* ctx, const WindowMeta& meta,
+                               const RECT& rcExt) {
+    int cW = meta.rcClient.right - meta.rcClient.left;
+    int cH = meta.rcClient.bottom - meta.rcClient.top;
+    if (cW <= 0 || cH <= 0) return;
+    int dx = meta.ptClient.x - rcExt.left;
+    int dy = meta.ptClient.y - rcExt.top;
+    LONG timeoutMs = g_printTimeoutMs;
 
-    ImageCodecInfo* pImageCodecInfo = (ImageCodecInfo*)(malloc(size));
-    if (pImageCodecInfo == NULL)
-        return -1; // Failure
+    PrintWindowJob* job = NULL;
+    HANDLE worker = NULL;
+    if (timeoutMs > 0) {
+        job = (PrintWindowJob*)malloc(sizeof(PrintWindowJob));
+        if (job) {
+            job->hwnd = meta.hwnd;
+            job->dc = CreateCompatibleDC(NULL);
+            job->bmp = job->dc ? CreateCaptureDib(cW, cH, NULL) : NULL;
+            job->oldBmp = NULL;
+            job->printed = FALSE;
+            job->state = 0;
+            if (job->bmp) {
+                job->oldBmp = (HBITMAP)SelectObject(job->dc, job->bmp);
+                worker = CreateThread(NULL, 0, PrintWindowProc, job, 0, NULL);
+                if (!worker) SelectObject(job->dc, job->oldBmp);
+            }
+            if (!worker) {
+                if (job->dc) DeleteDC(job->dc);
+                if (job->bmp) DeleteObject(job->bmp);
+                free(job);
+                job = NULL;
+            }
+        }
+    }
 
-    GetImageEncoders(num, size, pImageCodecInfo);
-    for (UINT j = 0; j < num; ++j) {
-        if (wcscmp(pImageCodecInfo[j].MimeType, format) == 0) {
-            *pClsid = pImageCodecInfo[j].Clsid;
-            free(pImageCodecInfo);
-            return j; // Success
+    if (worker) {
+        LONG64 tPw = StatClockStart();
+        ULONGLONG deadline = GetTickCount64() + (ULONGLONG)timeoutMs;
+        bool completed = false;
+        for (;;) {
+            ULONGLONG now = GetTickCount64();
+            DWORD wait = (now < deadline) ? (DWORD)(deadline - now) : 0;
+            DWORD r = MsgWaitForMultipleObjects(1, &worker, FALSE, wait,
+                                                QS_SENDMESSAGE);
+            if (r == WAIT_OBJECT_0 + 1) {
+                MSG msg;
+                PeekMessageW(&msg, NULL, 0, 0, PM_NOREMOVE | PM_QS_SENDMESSAGE);
+                continue;
+            }
+            completed = (r == WAIT_OBJECT_0);
+            break;
+        }
+        StatClockStop(StagePrintWindow, tPw);
+        CloseHandle(worker);
+        if (completed) {
+            SelectObject(job->dc, job->oldBmp);
+            if (job->printed) {
+                HBITMAP old = (HBITMAP)SelectObject(ctx->srcDC, job->bmp);
+                BitBlt(ctx->outDC, dx, dy, cW, cH, ctx->srcDC, 0, 0, SRCCOPY);
+                SelectObject(ctx->srcDC, old);
+            }
+            DeleteDC(job->dc);
+            DeleteObject(job->bmp);
+            free(job);
+        } else if (InterlockedCompareExchange(&job->state, 2, 0) == 1) {
+            // Worker finished between the timeout and here: its result is
+            // still dropped (the deadline passed), but cleanup is ours
+            SelectObject(job->dc, job->oldBmp);
+            DeleteDC(job->dc);
+            DeleteObject(job->bmp);
+            free(job);
         }
+        return;
     }
-    free(pImageCodecInfo);
-    return -1; // Failure
-}
 
-static std::wstring GenerateFileName(HWND hwnd) {
-    WCHAR title[256] = {0};
-    GetWindowTextW(hwnd, title, 256);
-    std::wstring name = title;
-    if (name.empty()) {
-        // fallback to class name
-        WCHAR classname[256] = {0};
-        GetClassNameW(hwnd, classname, 256);
-        name = classname;
-    }
-    // Remove/normalize characters: illegal -> '_', spaces -> '_', and lowercase all
-    for (auto& ch : name) {
-        if (ch == L'/' || ch == L'\\' || ch == L':' || ch == L'*' || ch == L'?' || ch == L'"' || ch == L'<' || ch == L'>' || ch == L'|') {
-            ch = L'_';
-        } else if (ch == L' ') {
-            ch = L'_';
-        } else {
-            ch = (WCHAR)towlower(ch);
-        }
-    }
-    if (name.empty()) {
-        name = L"window"; // fallback generic name
-    }
-    // Build full path
-    WCHAR fullPath[MAX_PATH];
-    wcscpy_s(fullPath, g_basePath.c_str());
-    // Ensure trailing backslash
-    size_t len = wcslen(fullPath);
-    if (len > 0 && fullPath[len - 1] != L'\\') {
-        wcscat_s(fullPath, L"\\");
-    }
-    wcscat_s(fullPath, name.c_str());
-    // Append .png (handle duplicates later)
-    wcscat_s(fullPath, L".png");
-    return std::wstring(fullPath);
-}
-
-static std::wstring EnsureUniquePath(const std::wstring& path) {
-    if (PathFileExistsW(path.c_str())) {
-        // Insert -N before extension
-        size_t dotPos = path.find_last_of(L'.');
-        std::wstring base = (dotPos == std::wstring::npos) ? path : path.substr(0, dotPos);
-        std::wstring ext = (dotPos == std::wstring::npos) ? L"" : path.substr(dotPos);
-        int idx = 1;
-        std::wstring candidate;
-        do {
-            std::wstringstream ss;
-            ss << base << L"-" << idx << ext;
-            candidate = ss.str();
-            idx++;
-        } while (PathFileExistsW(candidate.c_str()));
-        return candidate;
+    // Inline path: timeouts disabled, or the worker could not be set up
+    HBITMAP hCliBmp = AcquireScratchBitmap(ctx, cW, cH);
+    if (!hCliBmp) return;
+    HBITMAP hCliOld = (HBITMAP)SelectObject(ctx->srcDC, hCliBmp);
+    LONG64 tPw = StatClockStart();
+    BOOL printed = PrintWindow(meta.hwnd, ctx->srcDC, PW_CLIENTONLY);
+    StatClockStop(StagePrintWindow, tPw);
+    if (printed) {
+        BitBlt(ctx->outDC, dx, dy, cW, cH, ctx->srcDC, 0, 0, SRCCOPY);
     }
-    return path;
+    SelectObject(ctx->srcDC, hCliOld);
 }
 
 static void CaptureWindow(HWND hwnd, bool usePrintWindow) {
-    if (!IsWindow(hwnd)) return;
+    EnsureCaptureInit();
+    WindowMeta meta;
+    if (!SnapshotWindowMeta(hwnd, &meta)) return;
+
+    CaptureContext* ctx = GetCaptureContext();
+    if (!ctx) return;
 
-    RECT rcWin;
-    if (!GetWindowRect(hwnd, &rcWin)) return;
-    LONG_PTR style0 = GetWindowLongPtr(hwnd, GWL_STYLE);
-    LONG_PTR exstyle0 = GetWindowLongPtr(hwnd, GWL_EXSTYLE);
+    // ROI registered for this class: grab just that sub-rect from the screen
+    RECT rcRoi;
+    if (GetWindowRoi(meta, &rcRoi)) {
+        int w = rcRoi.right - rcRoi.left;
+        int h = rcRoi.bottom - rcRoi.top;
+        HDC hScreenDC = GetDC(NULL);
+        if (!hScreenDC) return;
+        void* bits = NULL;
+        HBITMAP hBmp = CreateCaptureDib(w, h, &bits);
+        if (hBmp) {
+            HBITMAP old = (HBITMAP)SelectObject(ctx->outDC, hBmp);
+            SeedFromScreen(ctx, hScreenDC, rcRoi, bits, w, h);
+            SelectObject(ctx->outDC, old);
+            SubmitCapture(hBmp, meta);
+        }
+        ReleaseDC(NULL, hScreenDC);
+        return;
+    }
 
     // Special handling for child/MDI child: capture via window DC at (0,0) to avoid DPI translation issues
-    if ((style0 & WS_CHILD) || (exstyle0 & WS_EX_MDICHILD)) {
-        int w = rcWin.right - rcWin.left;
-        int h = rcWin.bottom - rcWin.top;
+    if ((meta.style & WS_CHILD) || (meta.exstyle & WS_EX_MDICHILD)) {
+        int w = meta.rcWin.right - meta.rcWin.left;
+        int h = meta.rcWin.bottom - meta.rcWin.top;
         if (w <= 0 || h <= 0) return;
         HDC hWndDC = GetWindowDC(hwnd);
         if (!hWndDC) return;
-        HDC hMem = CreateCompatibleDC(hWndDC);
-        HBITMAP hBmp = CreateCompatibleBitmap(hWndDC, w, h);
-        if (!hMem || !hBmp) {
-            if (hBmp) DeleteObject(hBmp);
-            if (hMem) DeleteDC(hMem);
+        HBITMAP hBmp = CreateCaptureDib(w, h, NULL);
+        if (!hBmp) {
             ReleaseDC(hwnd, hWndDC);
             return;
         }
-        HBITMAP old = (HBITMAP)SelectObject(hMem, hBmp);
-        BitBlt(hMem, 0, 0, w, h, hWndDC, 0, 0, SRCCOPY);
-        SelectObject(hMem, old);
+        HBITMAP old = (HBITMAP)SelectObject(ctx->outDC, hBmp);
+        BitBlt(ctx->outDC, 0, 0, w, h, hWndDC, 0, 0, SRCCOPY);
+        SelectObject(ctx->outDC, old);
 
-        // Save
-        Bitmap bitmap(hBmp, NULL);
-        std::wstring path = GenerateFileName(hwnd);
-        path = EnsureUniquePath(path);
-        CLSID pngClsid;
-        if (GetEncoderClsid(L"image/png", &pngClsid) >= 0) {
-            bitmap.Save(path.c_str(), &pngClsid, NULL);
-        }
-
-        DeleteObject(hBmp);
-        DeleteDC(hMem);
+        // Hand off to the encoder thread (owns hBmp from here)
+        SubmitCapture(hBmp, meta);
         ReleaseDC(hwnd, hWndDC);
         return;
     }
-    RECT rcExt = rcWin;
-    GetExtendedRect(hwnd, &rcExt);
+    RECT rcExt = meta.rcExt;
     int extW = rcExt.right - rcExt.left;
     int extH = rcExt.bottom - rcExt.top;
     if (extW <= 0 || extH <= 0) return;
@@ -155,77 +2098,25 @@ static void CaptureWindow(HWND hwnd, bool usePrintWindow) {
     // Seed with what is on screen (gets modern NC/title)
     HDC hScreenDC = GetDC(NULL);
     if (!hScreenDC) return;
-    HDC hExtDC = CreateCompatibleDC(hScreenDC);
-    HBITMAP hExtBmp = CreateCompatibleBitmap(hScreenDC, extW, extH);
-    if (!hExtDC || !hExtBmp) {
-        if (hExtBmp) DeleteObject(hExtBmp);
-        if (hExtDC) DeleteDC(hExtDC);
+    void* extBits = NULL;
+    HBITMAP hExtBmp = CreateCaptureDib(extW, extH, &extBits);
+    if (!hExtBmp) {
         ReleaseDC(NULL, hScreenDC);
         return;
     }
-    HBITMAP hExtOld = (HBITMAP)SelectObject(hExtDC, hExtBmp);
-    BitBlt(hExtDC, 0, 0, extW, extH, hScreenDC, rcExt.left, rcExt.top, SRCCOPY);
+    HBITMAP hExtOld = (HBITMAP)SelectObject(ctx->outDC, hExtBmp);
+    SeedFromScreen(ctx, hScreenDC, rcExt, extBits, extW, extH);
 
     // Optionally overlay client area using PrintWindow; for MDI or child windows skip to prefer screen capture
-    LONG_PTR style = style0;
-    LONG_PTR exstyle = exstyle0;
-    bool allowPW = usePrintWindow; // for top-level windows only
-    if (allowPW) {
-        RECT rcClient; GetClientRect(hwnd, &rcClient);
-        POINT ptClient = {0, 0}; ClientToScreen(hwnd, &ptClient);
-        int cW = rcClient.right - rcClient.left;
-        int cH = rcClient.bottom - rcClient.top;
-        if (cW > 0 && cH > 0) {
-            HDC hCliDC = CreateCompatibleDC(hScreenDC);
-            HBITMAP hCliBmp = CreateCompatibleBitmap(hScreenDC, cW, cH);
-            if (hCliDC && hCliBmp) {
-                HBITMAP hCliOld = (HBITMAP)SelectObject(hCliDC, hCliBmp);
-                if (PrintWindow(hwnd, hCliDC, PW_CLIENTONLY)) {
-                    int dx = ptClient.x - rcExt.left;
-                    int dy = ptClient.y - rcExt.top;
-                    BitBlt(hExtDC, dx, dy, cW, cH, hCliDC, 0, 0, SRCCOPY);
-                }
-                SelectObject(hCliDC, hCliOld);
-            }
-            if (hCliBmp) DeleteObject(hCliBmp);
-            if (hCliDC) DeleteDC(hCliDC);
-        }
+    if (usePrintWindow) { // for top-level windows only
+        OverlayPrintWindow(ctx, meta, rcExt);
     }
 
-    SelectObject(hExtDC, hExtOld);
+    SelectObject(ctx->outDC, hExtOld);
     ReleaseDC(NULL, hScreenDC);
 
-    // Save
-    Bitmap bitmap(hExtBmp, NULL);
-    std::wstring path = GenerateFileName(hwnd);
-    path = EnsureUniquePath(path);
-    CLSID pngClsid;
-    if (GetEncoderClsid(L"image/png", &pngClsid) >= 0) {
-        bitmap.Save(path.c_str(), &pngClsid, NULL);
-    }
-    DeleteObject(hExtBmp);
-    DeleteDC(hExtDC);
-}
-
-// Helper to get extended frame bounds; falls back to GetWindowRect
-static BOOL GetExtendedRect(HWND hwnd, RECT* prc) {
-    if (!IsWindow(hwnd) || !prc) return FALSE;
-    RECT r;
-    if (!GetWindowRect(hwnd, &r)) return FALSE;
-    // For child/MDI child windows, prefer raw window rect; DWM ext bounds can be relative/misaligned
-    LONG_PTR style = GetWindowLongPtr(hwnd, GWL_STYLE);
-    LONG_PTR exstyle = GetWindowLongPtr(hwnd, GWL_EXSTYLE);
-    if (style & WS_CHILD || exstyle & WS_EX_MDICHILD) {
-        *prc = r;
-        return TRUE;
-    }
-    RECT rex = r;
-    if (SUCCEEDED(DwmGetWindowAttribute(hwnd, DWMWA_EXTENDED_FRAME_BOUNDS, &rex, sizeof(rex)))) {
-        *prc = rex;
-        return TRUE;
-    }
-    *prc = r;
-    return TRUE;
+    // Hand off to the encoder thread (owns hExtBmp from here)
+    SubmitCapture(hExtBmp, meta);
 }
 
 static HWND ResolveTopLevel(HWND h) {
@@ -262,78 +2153,393 @@ static HWND FindLikelyParentByPoint(HWND child) {
     return GetAncestor(child, GA_ROOTOWNER);
 }
 
+// ---- DXGI desktop-duplication grab backend ----
+// Optional replacement for the screen-DC BitBlt seed: reads the composited
+// desktop from the GPU through IDXGIOutputDuplication and a single staging-
+// texture readback, which is both faster for large windows and captures
+// D3D-rendered panes that BitBlt/PrintWindow render black. Selected at
+// runtime when d3d11/dxgi1.2 are present (Win8+); every failure path falls
+// back to the GDI grab. d3d11.dll is loaded dynamically so the DLL still
+// loads on systems without it.
+
+typedef HRESULT (WINAPI* PFN_D3D11CreateDevice)(
+    IDXGIAdapter*, D3D_DRIVER_TYPE, HMODULE, UINT,
+    const D3D_FEATURE_LEVEL*, UINT, UINT,
+    ID3D11Device**, D3D_FEATURE_LEVEL*, ID3D11DeviceContext**);
+
+// One duplication plus its CPU staging texture per attached output, so a
+// window spanning monitors can be assembled from per-output grabs instead of
+// one giant virtual-screen copy.
+#define DXGI_MAX_OUTPUTS 8
+
+struct DxgiOutputDup {
+    IDXGIOutputDuplication* dup;
+    RECT desktopRect;
+    ID3D11Texture2D* staging;
+    int stagingW, stagingH;
+    RECT stagingRect;  // screen rect currently held in staging
+    bool stagingValid;
+};
+
+static SRWLOCK g_dxgiLock = SRWLOCK_INIT; // grabs come from UI and burst threads
+static LONG g_dxgiState = 0;              // 0 untried, -1 unavailable
+static ID3D11Device* g_d3dDevice = NULL;
+static ID3D11DeviceContext* g_d3dContext = NULL;
+static DxgiOutputDup g_dxgiOutputs[DXGI_MAX_OUTPUTS];
+static int g_dxgiOutputCount = 0;
+static bool g_dxgiEnumerated = false;
+
+static bool DxgiEnsureDevice() {
+    if (g_dxgiState < 0) return false;
+    if (g_d3dDevice) return true;
+    HMODULE d3d11 = LoadLibraryW(L"d3d11.dll");
+    PFN_D3D11CreateDevice create = d3d11
+        ? (PFN_D3D11CreateDevice)GetProcAddress(d3d11, "D3D11CreateDevice") : NULL;
+    if (!create ||
+        FAILED(create(NULL, D3D_DRIVER_TYPE_HARDWARE, NULL, 0, NULL, 0,
+                      D3D11_SDK_VERSION, &g_d3dDevice, NULL, &g_d3dContext))) {
+        g_dxgiState = -1;
+        return false;
+    }
+    return true;
+}
+
+// Enumerates the adapter outputs once, creating a duplication per attached
+// identity-rotation output. Re-run after a duplication is lost.
+static bool DxgiEnsureOutputs() {
+    if (g_dxgiEnumerated) return g_dxgiOutputCount > 0;
+    for (int i = 0; i < g_dxgiOutputCount; ++i) {
+        if (g_dxgiOutputs[i].dup) g_dxgiOutputs[i].dup->Release();
+        if (g_dxgiOutputs[i].staging) g_dxgiOutputs[i].staging->Release();
+    }
+    memset(g_dxgiOutputs, 0, sizeof(g_dxgiOutputs));
+    g_dxgiOutputCount = 0;
+
+    IDXGIDevice* dxgiDev = NULL;
+    IDXGIAdapter* adapter = NULL;
+    if (SUCCEEDED(g_d3dDevice->QueryInterface(IID_PPV_ARGS(&dxgiDev))) &&
+        SUCCEEDED(dxgiDev->GetAdapter(&adapter))) {
+        IDXGIOutput* out = NULL;
+        for (UINT i = 0; g_dxgiOutputCount < DXGI_MAX_OUTPUTS &&
+                         adapter->EnumOutputs(i, &out) == S_OK; ++i) {
+            DXGI_OUTPUT_DESC desc;
+            out->GetDesc(&desc);
+            if (desc.AttachedToDesktop &&
+                desc.Rotation == DXGI_MODE_ROTATION_IDENTITY) {
+                IDXGIOutput1* out1 = NULL;
+                if (SUCCEEDED(out->QueryInterface(IID_PPV_ARGS(&out1)))) {
+                    DxgiOutputDup* o = &g_dxgiOutputs[g_dxgiOutputCount];
+                    if (SUCCEEDED(out1->DuplicateOutput(g_d3dDevice, &o->dup))) {
+                        o->desktopRect = desc.DesktopCoordinates;
+                        g_dxgiOutputCount++;
+                    }
+                    out1->Release();
+                }
+            }
+            out->Release();
+        }
+    }
+    if (adapter) adapter->Release();
+    if (dxgiDev) dxgiDev->Release();
+    g_dxgiEnumerated = true;
+    return g_dxgiOutputCount > 0;
+}
+
+static bool DxgiCopyStagingToDst(DxgiOutputDup* o, BYTE* dst, int w, int h, UINT dstStride) {
+    D3D11_MAPPED_SUBRESOURCE map;
+    if (FAILED(g_d3dContext->Map(o->staging, 0, D3D11_MAP_READ, 0, &map))) {
+        return false;
+    }
+    for (int y = 0; y < h; ++y) {
+        memcpy(dst + (SIZE_T)y * dstStride,
+               (BYTE*)map.pData + (SIZE_T)y * map.RowPitch, (SIZE_T)w * 4);
+    }
+    g_d3dContext->Unmap(o->staging, 0);
+    return true;
+}
+
+// Grabs rcScreen (wholly inside o's output) into dst. Lock already held.
+static bool DxgiGrabFromOutput(DxgiOutputDup* o, const RECT& rcScreen,
+                               BYTE* dst, int w, int h, UINT dstStride) {
+    DXGI_OUTDUPL_FRAME_INFO info;
+    IDXGIResource* res = NULL;
+    HRESULT hr = o->dup->AcquireNextFrame(100, &info, &res);
+    if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
+        // Output unchanged since the last grab: reuse the staging copy when
+        // it still covers this exact rect
+        if (o->stagingValid && EqualRect(&o->stagingRect, &rcScreen)) {
+            return DxgiCopyStagingToDst(o, dst, w, h, dstStride);
+        }
+        return false;
+    }
+    if (FAILED(hr)) {
+        // Duplication lost (mode change, secure desktop): re-enumerate next time
+        o->dup->Release();
+        o->dup = NULL;
+        o->stagingValid = false;
+        g_dxgiEnumerated = false;
+        return false;
+    }
+    bool ok = false;
+    ID3D11Texture2D* frame = NULL;
+    if (SUCCEEDED(res->QueryInterface(IID_PPV_ARGS(&frame)))) {
+        if (!o->staging || w > o->stagingW || h > o->stagingH) {
+            if (o->staging) {
+                o->staging->Release();
+                o->staging = NULL;
+            }
+            D3D11_TEXTURE2D_DESC sd = {};
+            sd.Width = max(w, o->stagingW);
+            sd.Height = max(h, o->stagingH);
+            sd.MipLevels = 1;
+            sd.ArraySize = 1;
+            sd.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+            sd.SampleDesc.Count = 1;
+            sd.Usage = D3D11_USAGE_STAGING;
+            sd.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+            if (SUCCEEDED(g_d3dDevice->CreateTexture2D(&sd, NULL, &o->staging))) {
+                o->stagingW = sd.Width;
+                o->stagingH = sd.Height;
+            }
+        }
+        if (o->staging) {
+            D3D11_BOX box;
+            box.left = rcScreen.left - o->desktopRect.left;
+            box.top = rcScreen.top - o->desktopRect.top;
+            box.right = box.left + w;
+            box.bottom = box.top + h;
+            box.front = 0;
+            box.back = 1;
+            g_d3dContext->CopySubresourceRegion(o->staging, 0, 0, 0, 0, frame, 0, &box);
+            o->stagingRect = rcScreen;
+            o->stagingValid = true;
+            ok = DxgiCopyStagingToDst(o, dst, w, h, dstStride);
+        }
+        frame->Release();
+    }
+    res->Release();
+    if (o->dup) o->dup->ReleaseFrame();
+    return ok;
+}
+
+// Copies the given screen rect into a top-down 32bpp buffer via desktop
+// duplication. A rect spanning outputs is assembled from per-output grabs;
+// any piece that fails makes the whole grab fail so the caller can BitBlt.
+static bool DxgiGrabRect(const RECT& rcScreen, BYTE* dst, int w, int h, UINT dstStride) {
+    if (!dst) return false;
+    bool ok = false;
+    AcquireSRWLockExclusive(&g_dxgiLock);
+    do {
+        if (!DxgiEnsureDevice()) break;
+        if (!DxgiEnsureOutputs()) break;
+        // Fast path: one output wholly contains the rect
+        DxgiOutputDup* whole = NULL;
+        for (int i = 0; i < g_dxgiOutputCount; ++i) {
+            RECT r;
+            if (g_dxgiOutputs[i].dup &&
+                IntersectRect(&r, &g_dxgiOutputs[i].desktopRect, &rcScreen) &&
+                EqualRect(&r, &rcScreen)) {
+                whole = &g_dxgiOutputs[i];
+                break;
+            }
+        }
+        if (whole) {
+            ok = DxgiGrabFromOutput(whole, rcScreen, dst, w, h, dstStride);
+            break;
+        }
+        // Spanning rect: grab each intersecting output's piece into place
+        bool covered = false;
+        bool failed = false;
+        for (int i = 0; i < g_dxgiOutputCount; ++i) {
+            RECT piece;
+            if (!g_dxgiOutputs[i].dup ||
+                !IntersectRect(&piece, &g_dxgiOutputs[i].desktopRect, &rcScreen)) {
+                continue;
+            }
+            covered = true;
+            int px = piece.left - rcScreen.left;
+            int py = piece.top - rcScreen.top;
+            int pw = piece.right - piece.left;
+            int ph = piece.bottom - piece.top;
+            if (!DxgiGrabFromOutput(&g_dxgiOutputs[i], piece,
+                                    dst + (SIZE_T)py * dstStride + (SIZE_T)px * 4,
+                                    pw, ph, dstStride)) {
+                failed = true;
+                break;
+            }
+        }
+        ok = covered && !failed;
+    } while (0);
+    ReleaseSRWLockExclusive(&g_dxgiLock);
+    return ok;
+}
+
+// GDI fallback seed. A single giant BitBlt against the virtual-screen DC
+// serializes across every monitor; when the rect spans monitors we instead
+// blit each intersecting monitor's piece from a per-monitor DC.
+struct MonitorSeedState {
+    HDC outDC;
+    RECT rcExt;
+    int blits;
+};
+
+static BOOL CALLBACK SeedMonitorProc(HMONITOR hMon, HDC, LPRECT, LPARAM lParam) {
+    MonitorSeedState* st = (MonitorSeedState*)lParam;
+    MONITORINFOEXW mi;
+    mi.cbSize = sizeof(mi);
+    if (!GetMonitorInfoW(hMon, &mi)) return TRUE;
+    RECT piece;
+    if (!IntersectRect(&piece, &mi.rcMonitor, &st->rcExt)) return TRUE;
+    HDC monDC = CreateDCW(L"DISPLAY", mi.szDevice, NULL, NULL);
+    if (!monDC) return TRUE;
+    BitBlt(st->outDC, piece.left - st->rcExt.left, piece.top - st->rcExt.top,
+           piece.right - piece.left, piece.bottom - piece.top,
+           monDC, piece.left - mi.rcMonitor.left, piece.top - mi.rcMonitor.top,
+           SRCCOPY);
+    DeleteDC(monDC);
+    st->blits++;
+    return TRUE;
+}
+
+// Seeds the output bitmap (selected into ctx->outDC) with the screen content
+// of rcExt: DXGI first, then per-monitor blits, then one virtual-screen blit.
+static void SeedFromScreen(CaptureContext* ctx, HDC hScreenDC, const RECT& rcExt,
+                           void* dibBits, int w, int h) {
+    LONG64 t0 = StatClockStart();
+    // DXGI writes the DIB bits directly, bypassing the DC
+    if (!DxgiGrabRect(rcExt, (BYTE*)dibBits, w, h, (UINT)w * 4)) {
+        MonitorSeedState st = { ctx->outDC, rcExt, 0 };
+        EnumDisplayMonitors(NULL, &rcExt, SeedMonitorProc, (LPARAM)&st);
+        if (st.blits == 0) {
+            BitBlt(ctx->outDC, 0, 0, w, h, hScreenDC, rcExt.left, rcExt.top, SRCCOPY);
+        }
+    }
+    StatClockStop(StageBlit, t0);
+}
+
 // Render a single window to a bitmap sized to its extended bounds. Includes modern NC/shadows
 // by seeding from the screen, then overlays the client via PrintWindow to remove occlusions.
 static HBITMAP RenderWindowBitmap(HWND hwnd, RECT* outExt, bool usePrintWindow) {
+    EnsureCaptureInit();
     if (outExt) SetRectEmpty(outExt);
-    if (!IsWindow(hwnd)) return NULL;
-    RECT rcWin{}; if (!GetWindowRect(hwnd, &rcWin)) return NULL;
-    RECT rcExt = rcWin; GetExtendedRect(hwnd, &rcExt);
+    WindowMeta meta;
+    if (!SnapshotWindowMeta(hwnd, &meta)) return NULL;
+
+    // ROI registered for this class: render just that sub-rect (used by
+    // burst and recording too, so every path pays ROI-sized cost)
+    RECT rcRoi;
+    if (GetWindowRoi(meta, &rcRoi)) {
+        int w = rcRoi.right - rcRoi.left;
+        int h = rcRoi.bottom - rcRoi.top;
+        CaptureContext* roiCtx = GetCaptureContext();
+        if (!roiCtx) return NULL;
+        HDC hScreen = GetDC(NULL);
+        if (!hScreen) return NULL;
+        void* bits = NULL;
+        HBITMAP hBmp = CreateCaptureDib(w, h, &bits);
+        if (hBmp) {
+            HBITMAP hOld = (HBITMAP)SelectObject(roiCtx->outDC, hBmp);
+            SeedFromScreen(roiCtx, hScreen, rcRoi, bits, w, h);
+            SelectObject(roiCtx->outDC, hOld);
+            if (outExt) *outExt = rcRoi;
+        }
+        ReleaseDC(NULL, hScreen);
+        return hBmp;
+    }
+
+    RECT rcExt = meta.rcExt;
     int w = rcExt.right - rcExt.left;
     int h = rcExt.bottom - rcExt.top;
     if (w <= 0 || h <= 0) return NULL;
 
+    CaptureContext* ctx = GetCaptureContext();
+    if (!ctx) return NULL;
     HDC hScreen = GetDC(NULL);
     if (!hScreen) return NULL;
-    HDC hMem = CreateCompatibleDC(hScreen);
-    HBITMAP hBmp = CreateCompatibleBitmap(hScreen, w, h);
-    if (!hMem || !hBmp) {
-        if (hBmp) DeleteObject(hBmp);
-        if (hMem) DeleteDC(hMem);
+    void* dibBits = NULL;
+    HBITMAP hBmp = CreateCaptureDib(w, h, &dibBits);
+    if (!hBmp) {
         ReleaseDC(NULL, hScreen);
         return NULL;
     }
-    HBITMAP hOld = (HBITMAP)SelectObject(hMem, hBmp);
     // Seed with what's on screen (modern NC and shadows)
-    BitBlt(hMem, 0, 0, w, h, hScreen, rcExt.left, rcExt.top, SRCCOPY);
+    HBITMAP hOld = (HBITMAP)SelectObject(ctx->outDC, hBmp);
+    SeedFromScreen(ctx, hScreen, rcExt, dibBits, w, h);
 
     // Optionally overlay client content (skip for MDI special-case)
     if (usePrintWindow) {
-        RECT rcCli{}; GetClientRect(hwnd, &rcCli);
-        POINT ptCli{0,0}; ClientToScreen(hwnd, &ptCli);
-        int cw = rcCli.right - rcCli.left;
-        int ch = rcCli.bottom - rcCli.top;
-        if (cw > 0 && ch > 0) {
-            HDC hCli = CreateCompatibleDC(hScreen);
-            HBITMAP hCliBmp = CreateCompatibleBitmap(hScreen, cw, ch);
-            if (hCli && hCliBmp) {
-                HBITMAP hCliOld = (HBITMAP)SelectObject(hCli, hCliBmp);
-                if (PrintWindow(hwnd, hCli, PW_CLIENTONLY)) {
-                    int dx = ptCli.x - rcExt.left;
-                    int dy = ptCli.y - rcExt.top;
-                    BitBlt(hMem, dx, dy, cw, ch, hCli, 0, 0, SRCCOPY);
-                }
-                SelectObject(hCli, hCliOld);
-            }
-            if (hCliBmp) DeleteObject(hCliBmp);
-            if (hCli) DeleteDC(hCli);
-        }
+        OverlayPrintWindow(ctx, meta, rcExt);
     }
 
-    SelectObject(hMem, hOld);
+    SelectObject(ctx->outDC, hOld);
     ReleaseDC(NULL, hScreen);
-    DeleteDC(hMem);
     if (outExt) *outExt = rcExt;
     return hBmp;
 }
 
-// Blit helper: draw a bitmap at a given destination offset
-static void BlitBitmap(HDC dst, int dx, int dy, HBITMAP bmp, int w, int h) {
-    HDC src = CreateCompatibleDC(dst);
-    if (!src) return;
-    HBITMAP old = (HBITMAP)SelectObject(src, bmp);
-    BitBlt(dst, dx, dy, w, h, src, 0, 0, SRCCOPY);
-    SelectObject(src, old);
-    DeleteDC(src);
+// Bench seam: the grab stage alone. Renders hwnd exactly as a hotkey capture
+// would (screen seed + PrintWindow overlay, updating the blit/print stage
+// counters) and hands the frame back instead of naming and queueing it.
+HBITMAP RenderWindowFrame(HWND hwnd) {
+    RECT rcExt;
+    return RenderWindowBitmap(hwnd, &rcExt, true);
+}
+
+// Blit helper: draw a bitmap at a given destination offset (via the pooled
+// source DC)
+static void BlitBitmap(CaptureContext* ctx, HDC dst, int dx, int dy, HBITMAP bmp, int w, int h) {
+    HBITMAP old = (HBITMAP)SelectObject(ctx->srcDC, bmp);
+    BitBlt(dst, dx, dy, w, h, ctx->srcDC, 0, 0, SRCCOPY);
+    SelectObject(ctx->srcDC, old);
+}
+
+// Worker side of the parallel composite: renders the behind window while the
+// hooked thread renders the child. Gets its own thread-local CaptureContext.
+struct UnionRenderJob {
+    HWND hwnd;
+    RECT rcExt;
+    HBITMAP bmp;
+};
+
+static DWORD WINAPI UnionRenderProc(LPVOID param) {
+    UnionRenderJob* job = (UnionRenderJob*)param;
+    job->bmp = RenderWindowBitmap(job->hwnd, &job->rcExt, true);
+    // The render's blits are batched in this thread's GDI queue; flush
+    // before the composite thread reads the bits.
+    GdiFlush();
+    return 0;
 }
 
 // Capture union of owner (as background) then child (overlay)
 static void CaptureWindowUnion(HWND child, HWND behind) {
     if (!IsWindow(child) || !IsWindow(behind)) return;
 
+    // The two renders are independent until the final composite, and the
+    // behind window's PrintWindow runs in another process where it can block
+    // for >100ms, so render it on a worker while this thread renders the
+    // child; Shift+F11 then costs one render, not two.
     RECT rcChildExt{}, rcBehindExt{};
+    UnionRenderJob job = { behind, {0, 0, 0, 0}, NULL };
+    HANDLE worker = CreateThread(NULL, 0, UnionRenderProc, &job, 0, NULL);
     HBITMAP bmpChild = RenderWindowBitmap(child, &rcChildExt, true);
-    HBITMAP bmpBehind = RenderWindowBitmap(behind, &rcBehindExt, true);
+    HBITMAP bmpBehind = NULL;
+    if (worker) {
+        // Deliver inter-thread sent messages while waiting: if the behind
+        // window lives on this thread, its WM_PRINT must be processed here
+        // or the worker's PrintWindow would deadlock against this wait.
+        for (;;) {
+            DWORD r = MsgWaitForMultipleObjects(1, &worker, FALSE, INFINITE,
+                                                QS_SENDMESSAGE);
+            if (r != WAIT_OBJECT_0 + 1) break;
+            MSG msg;
+            PeekMessageW(&msg, NULL, 0, 0, PM_NOREMOVE | PM_QS_SENDMESSAGE);
+        }
+        CloseHandle(worker);
+        bmpBehind = job.bmp;
+        rcBehindExt = job.rcExt;
+    } else {
+        bmpBehind = RenderWindowBitmap(behind, &rcBehindExt, true);
+    }
     if (!bmpChild || !bmpBehind) {
         if (bmpChild) DeleteObject(bmpChild);
         if (bmpBehind) DeleteObject(bmpBehind);
@@ -353,46 +2559,640 @@ static void CaptureWindowUnion(HWND child, HWND behind) {
         return;
     }
 
+    CaptureContext* ctx = GetCaptureContext();
     HDC hScreen = GetDC(NULL);
-    HDC hMem = CreateCompatibleDC(hScreen);
-    HBITMAP hOut = CreateCompatibleBitmap(hScreen, w, h);
-    if (!hMem || !hOut) {
-        if (hOut) DeleteObject(hOut);
-        if (hMem) DeleteDC(hMem);
-        ReleaseDC(NULL, hScreen);
+    HBITMAP hOut = (ctx && hScreen) ? CreateCaptureDib(w, h, NULL) : NULL;
+    if (!hOut) {
+        if (hScreen) ReleaseDC(NULL, hScreen);
         DeleteObject(bmpChild);
         DeleteObject(bmpBehind);
         return;
     }
-    HBITMAP old = (HBITMAP)SelectObject(hMem, hOut);
+    HBITMAP old = (HBITMAP)SelectObject(ctx->outDC, hOut);
     RECT rFill = {0,0,w,h};
-    FillRect(hMem, &rFill, (HBRUSH)GetStockObject(WHITE_BRUSH));
+    FillRect(ctx->outDC, &rFill, (HBRUSH)GetStockObject(WHITE_BRUSH));
 
     // Draw parent then child at their offsets relative to union
     int pw = rcBehindExt.right - rcBehindExt.left;
     int ph = rcBehindExt.bottom - rcBehindExt.top;
     int cw = rcChildExt.right - rcChildExt.left;
     int ch = rcChildExt.bottom - rcChildExt.top;
-    BlitBitmap(hMem, rcBehindExt.left - rcU.left, rcBehindExt.top - rcU.top, bmpBehind, pw, ph);
-    BlitBitmap(hMem, rcChildExt.left - rcU.left, rcChildExt.top - rcU.top, bmpChild, cw, ch);
+    BlitBitmap(ctx, ctx->outDC, rcBehindExt.left - rcU.left, rcBehindExt.top - rcU.top, bmpBehind, pw, ph);
+    BlitBitmap(ctx, ctx->outDC, rcChildExt.left - rcU.left, rcChildExt.top - rcU.top, bmpChild, cw, ch);
 
-    SelectObject(hMem, old);
+    SelectObject(ctx->outDC, old);
 
-    // Save final composite
-    Bitmap bitmap(hOut, NULL);
-    std::wstring path = GenerateFileName(child);
-    path = EnsureUniquePath(path);
-    CLSID pngClsid;
-    if (GetEncoderClsid(L"image/png", &pngClsid) >= 0) {
-        bitmap.Save(path.c_str(), &pngClsid, NULL);
+    // Hand off the composite to the encoder thread (owns hOut from here);
+    // the composite is named after the child window
+    WindowMeta childMeta;
+    if (SnapshotWindowMeta(child, &childMeta)) {
+        SubmitCapture(hOut, childMeta);
+    } else {
+        DeleteObject(hOut);
     }
-    DeleteObject(hOut);
-    DeleteDC(hMem);
     ReleaseDC(NULL, hScreen);
     DeleteObject(bmpChild);
     DeleteObject(bmpBehind);
 }
 
+// ---- Batch capture ----
+// "Capture everything" for incident snapshots: every visible top-level
+// window of this process in one shot (Ctrl+F11, or the CaptureAllWindows
+// export). The grab loop runs on the calling thread — seeds are cheap
+// BitBlts, and EnumWindows hands windows back in Z-order so the screen DC
+// is walked top to bottom once — then the CPU side (downscale, dedupe,
+// encode, write) fans out across a transient worker pool that saves
+// inline instead of funneling through the single encoder thread. Ten
+// windows cost roughly one window's wall time per pool width.
+
+#define BATCH_MAX 16
+
+struct BatchItem {
+    HBITMAP bmp;
+    WindowMeta meta;
+};
+
+struct BatchState {
+    BatchItem items[BATCH_MAX];
+    int count;
+    volatile LONG next;   // claim cursor for the workers
+    volatile LONG active; // outstanding references; last one frees the state
+    WCHAR basePath[MAX_PATH];
+};
+
+struct BatchEnumCtx {
+    HWND targets[BATCH_MAX];
+    int count;
+};
+
+static BOOL CALLBACK BatchEnumProc(HWND hwnd, LPARAM lp) {
+    BatchEnumCtx* en = (BatchEnumCtx*)lp;
+    if (en->count >= BATCH_MAX) return FALSE;
+    DWORD pid = 0;
+    GetWindowThreadProcessId(hwnd, &pid);
+    if (pid != GetCurrentProcessId()) return TRUE;
+    if (!IsWindowVisible(hwnd) || IsIconic(hwnd)) return TRUE;
+    en->targets[en->count++] = hwnd;
+    return TRUE;
+}
+
+static DWORD WINAPI BatchEncodeProc(LPVOID param) {
+    BatchState* st = (BatchState*)param;
+    // Names resolve under the directory of the thread that started the batch
+    wcsncpy_s(t_basePath, _countof(t_basePath), st->basePath, _TRUNCATE);
+    t_encodeInline = true;
+    for (;;) {
+        LONG i = InterlockedIncrement(&st->next) - 1;
+        if (i >= st->count) break;
+        SubmitCapture(st->items[i].bmp, st->items[i].meta);
+    }
+    if (InterlockedDecrement(&st->active) == 0) free(st);
+    return 0;
+}
+
+static void CaptureAllProcessWindows() {
+    EnsureCaptureInit();
+    if (!t_basePath[0]) return;
+    BatchEnumCtx en = {};
+    EnumWindows(BatchEnumProc, (LPARAM)&en);
+    if (en.count == 0) return;
+
+    BatchState* st = (BatchState*)malloc(sizeof(BatchState));
+    if (!st) return;
+    st->count = 0;
+    st->next = 0;
+    wcsncpy_s(st->basePath, _countof(st->basePath), t_basePath, _TRUNCATE);
+
+    // Grab pass: seed every window before any encode starts. Enabling the
+    // metadata cache keeps the snapshot RenderWindowBitmap just took warm
+    // for the copy stored with the frame.
+    bool cacheWas = t_metaCacheOn;
+    t_metaCacheOn = true;
+    for (int i = 0; i < en.count; ++i) {
+        BatchItem* item = &st->items[st->count];
+        HBITMAP bmp = RenderWindowBitmap(en.targets[i], NULL, true);
+        if (bmp && SnapshotWindowMeta(en.targets[i], &item->meta)) {
+            item->bmp = bmp;
+            st->count++;
+        } else if (bmp) {
+            DeleteObject(bmp);
+        }
+    }
+    t_metaCacheOn = cacheWas;
+    if (st->count == 0) {
+        free(st);
+        return;
+    }
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int workers = (int)si.dwNumberOfProcessors;
+    if (workers > st->count) workers = st->count;
+    if (workers > 8) workers = 8;
+
+    st->active = workers + 1; // +1: this thread's reference
+    int started = 0;
+    for (int i = 0; i < workers; ++i) {
+        HANDLE t = CreateThread(NULL, 0, BatchEncodeProc, st, 0, NULL);
+        if (t) {
+            CloseHandle(t);
+            started++;
+        } else {
+            InterlockedDecrement(&st->active);
+        }
+    }
+    if (started == 0) {
+        // No pool came up: encode inline (the shared queue still applies)
+        for (int i = 0; i < st->count; ++i) {
+            SubmitCapture(st->items[i].bmp, st->items[i].meta);
+        }
+    }
+    if (InterlockedDecrement(&st->active) == 0) free(st);
+}
+
+// ---- Burst capture ----
+// A burst grabs N frames of the same window at a fixed rate on a dedicated
+// thread; every grabbed frame goes straight into the encode queue, so frame
+// K+1 is being grabbed while frame K compresses. The hooked UI thread only
+// starts the burst, so the message loop never stalls.
+static volatile LONG g_burstFrames = 1; // 1 = burst disabled, F11 = single shot
+static volatile LONG g_burstFps = 10;
+static volatile LONG g_burstActive = 0;
+static volatile LONG g_burstIncremental = 1; // diff frames, skip/crop unchanged
+
+struct BurstJob {
+    HWND hwnd;
+    bool usePrintWindow;
+    int frames;
+    int fps;
+    WCHAR basePath[MAX_PATH]; // inherited from the starting UI thread
+};
+
+// Row-wise diff of two same-sized top-down 32bpp frames. Returns false when
+// identical; otherwise true with the [first, last] changed row span.
+static bool DiffFrameRows(const BYTE* a, const BYTE* b, int w, int h, UINT stride,
+                          int* firstRow, int* lastRow) {
+    int first = -1;
+    int last = -1;
+    for (int y = 0; y < h; ++y) {
+        if (!RowsEqual<PixelBgra32>(a + (SIZE_T)y * stride, b + (SIZE_T)y * stride, w)) {
+            if (first < 0) first = y;
+            last = y;
+        }
+    }
+    if (first < 0) return false;
+    *firstRow = first;
+    *lastRow = last;
+    return true;
+}
+
+static DWORD WINAPI BurstThreadProc(LPVOID param) {
+    BurstJob job = *(BurstJob*)param;
+    free(param);
+    // Captures submitted from this thread name files under the directory of
+    // the UI thread that started the burst
+    wcsncpy_s(t_basePath, _countof(t_basePath), job.basePath, _TRUNCATE);
+    // Burst frames hit the same window back to back; let the metadata
+    // snapshot cache serve the repeats
+    t_metaCacheOn = true;
+    LARGE_INTEGER freq, start;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    LONGLONG ticksPerFrame = freq.QuadPart / max(job.fps, 1);
+    bool incremental = g_burstIncremental != 0;
+
+    // Retained copy of the previous frame for the incremental diff
+    BYTE* prev = NULL;
+    SIZE_T prevCap = 0;
+    int prevW = 0, prevH = 0;
+
+    for (int i = 0; i < job.frames && IsWindow(job.hwnd); ++i) {
+        RECT rcExt{};
+        HBITMAP bmp = RenderWindowBitmap(job.hwnd, &rcExt, job.usePrintWindow);
+        if (bmp) {
+            DIBSECTION ds = {};
+            if (incremental &&
+                GetObjectW(bmp, sizeof(ds), &ds) == sizeof(ds) && ds.dsBm.bmBits) {
+                GdiFlush();
+                int w = ds.dsBm.bmWidth;
+                int h = ds.dsBm.bmHeight;
+                UINT stride = (UINT)ds.dsBm.bmWidthBytes;
+                BYTE* bits = (BYTE*)ds.dsBm.bmBits;
+                SIZE_T frameBytes = (SIZE_T)stride * h;
+
+                bool hadPrev = (prev && prevW == w && prevH == h);
+                int firstRow = 0, lastRow = h - 1;
+                if (hadPrev && !DiffFrameRows(prev, bits, w, h, stride, &firstRow, &lastRow)) {
+                    // Nothing changed since the last frame: drop it
+                    DeleteObject(bmp);
+                    bmp = NULL;
+                } else {
+                    // Retain the full frame as the next diff baseline
+                    if (frameBytes > prevCap) {
+                        free(prev);
+                        prev = (BYTE*)malloc(frameBytes);
+                        prevCap = prev ? frameBytes : 0;
+                    }
+                    if (prev && prevCap >= frameBytes) {
+                        memcpy(prev, bits, frameBytes);
+                        prevW = w;
+                        prevH = h;
+                    }
+                    // Small change against a known baseline: encode only the
+                    // dirty row band instead of the full frame
+                    if (hadPrev && lastRow - firstRow + 1 < h / 2) {
+                        int spanH = lastRow - firstRow + 1;
+                        void* cropBits = NULL;
+                        HBITMAP crop = CreateCaptureDib(w, spanH, &cropBits);
+                        if (crop) {
+                            memcpy(cropBits, bits + (SIZE_T)firstRow * stride,
+                                   (SIZE_T)spanH * stride);
+                            DeleteObject(bmp);
+                            bmp = crop;
+                        }
+                    }
+                }
+            }
+            if (bmp) {
+                // Cache hit: RenderWindowBitmap just snapshotted this window
+                WindowMeta meta;
+                if (SnapshotWindowMeta(job.hwnd, &meta)) {
+                    SubmitCapture(bmp, meta);
+                } else {
+                    DeleteObject(bmp);
+                }
+            }
+        }
+        // Pace against the burst start so per-frame jitter does not accumulate
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        LONGLONG deadline = start.QuadPart + (LONGLONG)(i + 1) * ticksPerFrame;
+        if (now.QuadPart < deadline) {
+            Sleep((DWORD)((deadline - now.QuadPart) * 1000 / freq.QuadPart));
+        }
+    }
+    free(prev);
+    InterlockedExchange(&g_burstActive, 0);
+    return 0;
+}
+
+// Returns true when the keypress was consumed by burst mode (started a new
+// burst, or one is already running).
+static bool StartBurstCapture(HWND hwnd, bool usePrintWindow) {
+    LONG frames = g_burstFrames;
+    if (frames <= 1) return false;
+    if (InterlockedCompareExchange(&g_burstActive, 1, 0) != 0) return true;
+    BurstJob* job = (BurstJob*)malloc(sizeof(BurstJob));
+    if (!job) {
+        InterlockedExchange(&g_burstActive, 0);
+        return false;
+    }
+    job->hwnd = hwnd;
+    job->usePrintWindow = usePrintWindow;
+    job->frames = frames;
+    job->fps = g_burstFps;
+    wcsncpy_s(job->basePath, _countof(job->basePath), t_basePath, _TRUNCATE);
+    HANDLE h = CreateThread(NULL, 0, BurstThreadProc, job, 0, NULL);
+    if (!h) {
+        free(job);
+        InterlockedExchange(&g_burstActive, 0);
+        return false;
+    }
+    CloseHandle(h);
+    return true;
+}
+
+// ---- Streaming recording ----
+// Short recordings of a window for bug reproduction. StartRecording grabs
+// the target at a fixed rate on a dedicated thread and streams frames
+// through a second delta/compress thread into an append-only ".screc"
+// container: a small file header followed by length-prefixed QOI records,
+// where unchanged frames are dropped and small changes are cropped to
+// their dirty row band (the same diffing burst mode uses). The stages
+// pipeline — grab on one thread, delta+compress on another, and the file
+// append issued as a single outstanding overlapped write so the next
+// frame compresses while the previous record is still landing.
+
+#define RECORD_RING 4 // grab-to-compress hand-off depth
+
+struct RecordFileHeader {
+    char magic[4]; // "SCRC"
+    DWORD version; // 1
+    DWORD fps;
+    DWORD reserved;
+};
+
+// One record in the stream, immediately followed by payloadSize bytes of
+// QOI data: a full frame for keyframes, the dirty row band for deltas.
+struct RecordFrameHeader {
+    DWORD payloadSize;
+    WORD kind;      // 0 = keyframe, 1 = row-band delta
+    WORD reserved;
+    DWORD tickMs;   // GetTickCount at grab time
+    int w, h;       // full frame dimensions
+    int firstRow;   // band start (0 for keyframes)
+    int rowCount;   // band height (== h for keyframes)
+};
+
+struct RecordingState {
+    HWND target;
+    int fps;
+    HANDLE file;       // opened FILE_FLAG_OVERLAPPED, append via explicit offsets
+    HANDLE grabThread;
+    HANDLE compressThread;
+    HANDLE slotFree;   // semaphore: remaining ring capacity
+    HANDLE slotReady;  // semaphore: grabbed frames awaiting compression
+    volatile LONG stop;
+    HBITMAP ring[RECORD_RING];
+    DWORD ringTick[RECORD_RING];
+    int ringHead;      // grab thread only
+    int ringTail;      // compress thread only
+};
+
+static RecordingState* g_recording = NULL;
+static volatile LONG g_recordingActive = 0;
+
+static DWORD WINAPI RecordGrabProc(LPVOID param) {
+    RecordingState* rec = (RecordingState*)param;
+    LARGE_INTEGER freq, start, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    LONGLONG ticksPerFrame = freq.QuadPart / rec->fps;
+    for (LONGLONG i = 0; !rec->stop; ++i) {
+        if (!IsWindow(rec->target)) break;
+        HBITMAP bmp = RenderWindowBitmap(rec->target, NULL, true);
+        if (bmp) {
+            GdiFlush(); // compress thread reads the bits
+            // If the compressor is behind, drop the frame instead of
+            // stalling and skewing the capture clock.
+            if (WaitForSingleObject(rec->slotFree, 0) == WAIT_OBJECT_0) {
+                rec->ring[rec->ringHead] = bmp;
+                rec->ringTick[rec->ringHead] = GetTickCount();
+                rec->ringHead = (rec->ringHead + 1) % RECORD_RING;
+                ReleaseSemaphore(rec->slotReady, 1, NULL);
+            } else {
+                DeleteObject(bmp);
+            }
+        }
+        QueryPerformanceCounter(&now);
+        LONGLONG deadline = start.QuadPart + (i + 1) * ticksPerFrame;
+        if (now.QuadPart < deadline) {
+            Sleep((DWORD)((deadline - now.QuadPart) * 1000 / freq.QuadPart));
+        }
+    }
+    // Wake the compressor so it can observe the stop flag
+    ReleaseSemaphore(rec->slotReady, 1, NULL);
+    return 0;
+}
+
+static DWORD WINAPI RecordCompressProc(LPVOID param) {
+    RecordingState* rec = (RecordingState*)param;
+    BYTE* prev = NULL;
+    SIZE_T prevCap = 0;
+    int prevW = 0, prevH = 0;
+    // Double-buffered records: encode into one buffer while the other is
+    // still in flight in the single outstanding overlapped write.
+    BYTE* buf[2] = { NULL, NULL };
+    SIZE_T bufCap[2] = { 0, 0 };
+    int cur = 0;
+    bool pending = false;
+    LONGLONG offset = sizeof(RecordFileHeader);
+    OVERLAPPED ov = {};
+    ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+    for (;;) {
+        WaitForSingleObject(rec->slotReady, INFINITE);
+        if (rec->ringTail == rec->ringHead && rec->stop) break;
+        HBITMAP bmp = rec->ring[rec->ringTail];
+        DWORD tick = rec->ringTick[rec->ringTail];
+        rec->ringTail = (rec->ringTail + 1) % RECORD_RING;
+        ReleaseSemaphore(rec->slotFree, 1, NULL);
+
+        int w, h;
+        UINT stride;
+        BYTE* pixels;
+        if (!GetBitmapPixels(bmp, &w, &h, &stride, &pixels)) {
+            DeleteObject(bmp);
+            continue;
+        }
+        bool key = !(prev && prevW == w && prevH == h);
+        int firstRow = 0, lastRow = h - 1;
+        bool changed = true;
+        if (!key) {
+            changed = DiffFrameRows(prev, pixels, w, h, stride, &firstRow, &lastRow);
+        }
+        if (changed) {
+            int rows = key ? h : (lastRow - firstRow + 1);
+            int bandFirst = key ? 0 : firstRow;
+            SIZE_T cap = sizeof(RecordFrameHeader) + (SIZE_T)w * rows * 4 + 14 + 8;
+            if (cap > bufCap[cur]) {
+                free(buf[cur]);
+                buf[cur] = (BYTE*)malloc(cap);
+                bufCap[cur] = buf[cur] ? cap : 0;
+            }
+            if (buf[cur]) {
+                RecordFrameHeader* hdr = (RecordFrameHeader*)buf[cur];
+                SIZE_T qoiSize = QoiEncode(pixels + (SIZE_T)bandFirst * stride,
+                                           w, rows, stride,
+                                           buf[cur] + sizeof(RecordFrameHeader));
+                hdr->payloadSize = (DWORD)qoiSize;
+                hdr->kind = key ? 0 : 1;
+                hdr->reserved = 0;
+                hdr->tickMs = tick;
+                hdr->w = w;
+                hdr->h = h;
+                hdr->firstRow = bandFirst;
+                hdr->rowCount = rows;
+                DWORD recordSize = (DWORD)(sizeof(RecordFrameHeader) + qoiSize);
+                // Land the previous record before reusing its buffer slot
+                if (pending) {
+                    DWORD done = 0;
+                    GetOverlappedResult(rec->file, &ov, &done, TRUE);
+                    pending = false;
+                }
+                ov.Offset = (DWORD)offset;
+                ov.OffsetHigh = (DWORD)(offset >> 32);
+                if (WriteFile(rec->file, buf[cur], recordSize, NULL, &ov) ||
+                    GetLastError() == ERROR_IO_PENDING) {
+                    pending = true;
+                    offset += recordSize;
+                    cur = 1 - cur;
+                }
+            }
+            // Retain the full frame as the next diff baseline
+            SIZE_T frameBytes = (SIZE_T)stride * h;
+            if (frameBytes > prevCap) {
+                free(prev);
+                prev = (BYTE*)malloc(frameBytes);
+                prevCap = prev ? frameBytes : 0;
+            }
+            if (prev) {
+                memcpy(prev, pixels, frameBytes);
+                prevW = w;
+                prevH = h;
+            } else {
+                prevW = prevH = 0;
+            }
+        }
+        ArenaReset();
+        DeleteObject(bmp);
+    }
+
+    if (pending) {
+        DWORD done = 0;
+        GetOverlappedResult(rec->file, &ov, &done, TRUE);
+    }
+    if (ov.hEvent) CloseHandle(ov.hEvent);
+    free(buf[0]);
+    free(buf[1]);
+    free(prev);
+    return 0;
+}
+
+// Starts recording hwnd (NULL = current foreground window) at fps frames
+// per second into the given UTF-8 file path. One recording at a time.
+extern "C" __declspec(dllexport) BOOL WINAPI StartRecording(const char* path, HWND hwnd, int fps) {
+    if (!path) return FALSE;
+    if (fps < 1) fps = 5;
+    if (fps > 60) fps = 60;
+    if (!hwnd) hwnd = GetForegroundWindow();
+    if (!IsWindow(hwnd)) return FALSE;
+    if (InterlockedCompareExchange(&g_recordingActive, 1, 0) != 0) return FALSE;
+
+    WCHAR wpath[MAX_PATH];
+    if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH)) {
+        InterlockedExchange(&g_recordingActive, 0);
+        return FALSE;
+    }
+    RecordingState* rec = (RecordingState*)calloc(1, sizeof(RecordingState));
+    HANDLE file = CreateFileW(wpath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
+    if (!rec || file == INVALID_HANDLE_VALUE) {
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        free(rec);
+        InterlockedExchange(&g_recordingActive, 0);
+        return FALSE;
+    }
+    rec->target = hwnd;
+    rec->fps = fps;
+    rec->file = file;
+    rec->slotFree = CreateSemaphoreW(NULL, RECORD_RING, RECORD_RING, NULL);
+    rec->slotReady = CreateSemaphoreW(NULL, 0, RECORD_RING + 1, NULL);
+
+    RecordFileHeader fh = { { 'S', 'C', 'R', 'C' }, 1, (DWORD)fps, 0 };
+    OVERLAPPED ov = {};
+    ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    BOOL headerOk = FALSE;
+    if (rec->slotFree && rec->slotReady && ov.hEvent) {
+        DWORD done = 0;
+        if (WriteFile(file, &fh, sizeof(fh), NULL, &ov) ||
+            GetLastError() == ERROR_IO_PENDING) {
+            headerOk = GetOverlappedResult(file, &ov, &done, TRUE);
+        }
+    }
+    if (ov.hEvent) CloseHandle(ov.hEvent);
+    if (headerOk) {
+        rec->compressThread = CreateThread(NULL, 0, RecordCompressProc, rec, 0, NULL);
+        rec->grabThread = rec->compressThread
+            ? CreateThread(NULL, 0, RecordGrabProc, rec, 0, NULL) : NULL;
+    }
+    if (!rec->grabThread) {
+        InterlockedExchange(&rec->stop, 1);
+        if (rec->compressThread) {
+            ReleaseSemaphore(rec->slotReady, 1, NULL);
+            WaitForSingleObject(rec->compressThread, INFINITE);
+            CloseHandle(rec->compressThread);
+        }
+        if (rec->slotFree) CloseHandle(rec->slotFree);
+        if (rec->slotReady) CloseHandle(rec->slotReady);
+        CloseHandle(file);
+        free(rec);
+        InterlockedExchange(&g_recordingActive, 0);
+        return FALSE;
+    }
+    g_recording = rec;
+    return TRUE;
+}
+
+// Stops the active recording, drains both pipeline stages, and closes the
+// container. Safe to call when nothing is recording.
+extern "C" __declspec(dllexport) void WINAPI StopRecording(void) {
+    RecordingState* rec = g_recording;
+    if (!rec) return;
+    g_recording = NULL;
+    InterlockedExchange(&rec->stop, 1);
+    WaitForSingleObject(rec->grabThread, INFINITE);
+    WaitForSingleObject(rec->compressThread, INFINITE);
+    CloseHandle(rec->grabThread);
+    CloseHandle(rec->compressThread);
+    CloseHandle(rec->slotFree);
+    CloseHandle(rec->slotReady);
+    CloseHandle(rec->file);
+    free(rec);
+    InterlockedExchange(&g_recordingActive, 0);
+}
+
+// ---- Capture scheduler ----
+// Key auto-repeat can deliver several F11 WM_KEYUPs within ~100ms; capturing
+// inline for each stacks multi-hundred-ms stalls back to back on the UI
+// thread. Requests are queued instead: repeats for the same target inside
+// the coalescing window merge into one capture, and distinct targets drain
+// one per timer tick, so no input rate costs more than one capture per
+// window. All state is thread_local, like the hook itself, and the timer
+// fires on the hooked thread so captures still run where they always did.
+
+#define SCHED_QUEUE_MAX 8
+
+struct PendingCapture {
+    HWND target;
+    bool usePrintWindow;
+};
+
+static thread_local PendingCapture t_schedQueue[SCHED_QUEUE_MAX];
+static thread_local int t_schedCount = 0;
+static thread_local UINT_PTR t_schedTimer = 0;
+static volatile LONG g_coalesceMs = 150; // 0 = capture inline as before
+
+static void RunPendingCapture(HWND target, bool usePrintWindow) {
+    if (!IsWindow(target)) return; // target closed while queued
+    if (!StartBurstCapture(target, usePrintWindow)) {
+        CaptureWindow(target, usePrintWindow);
+    }
+}
+
+static void CALLBACK SchedTimerProc(HWND, UINT, UINT_PTR, DWORD) {
+    if (t_schedCount > 0) {
+        PendingCapture next = t_schedQueue[0];
+        t_schedCount--;
+        memmove(&t_schedQueue[0], &t_schedQueue[1],
+                (size_t)t_schedCount * sizeof(PendingCapture));
+        RunPendingCapture(next.target, next.usePrintWindow);
+    }
+    if (t_schedCount == 0 && t_schedTimer) {
+        KillTimer(NULL, t_schedTimer);
+        t_schedTimer = 0;
+    }
+}
+
+// Queues (or merges) a capture request for this thread's scheduler.
+static void ScheduleCapture(HWND target, bool usePrintWindow) {
+    for (int i = 0; i < t_schedCount; ++i) {
+        if (t_schedQueue[i].target == target) {
+            t_schedQueue[i].usePrintWindow = usePrintWindow;
+            // Restart the window so a run of key repeats yields one capture
+            t_schedTimer = SetTimer(NULL, t_schedTimer, (UINT)g_coalesceMs, SchedTimerProc);
+            return;
+        }
+    }
+    if (t_schedCount >= SCHED_QUEUE_MAX) return; // saturated: drop
+    t_schedQueue[t_schedCount].target = target;
+    t_schedQueue[t_schedCount].usePrintWindow = usePrintWindow;
+    t_schedCount++;
+    if (!t_schedTimer) {
+        t_schedTimer = SetTimer(NULL, 0, (UINT)g_coalesceMs, SchedTimerProc);
+    }
+}
+
 static LRESULT CALLBACK GetMsgProc(int nCode, WPARAM wParam, LPARAM lParam) {
     if (nCode >= 0) {
         MSG* pMsg = (MSG*)lParam;
@@ -416,7 +3216,11 @@ static LRESULT CALLBACK GetMsgProc(int nCode, WPARAM wParam, LPARAM lParam) {
             }
 
             bool shiftDown = (GetKeyState(VK_SHIFT) & 0x8000) != 0;
-            if (shiftDown && target) {
+            bool ctrlDown = (GetKeyState(VK_CONTROL) & 0x8000) != 0;
+            if (ctrlDown) {
+                // Ctrl+F11: incident snapshot of every process window
+                CaptureAllProcessWindows();
+            } else if (shiftDown && target) {
                 if (isMdi) {
                     // For MDI child, capture the main application window instead (no PrintWindow)
                     HWND mainWin = GetAncestor(target, GA_ROOTOWNER);
@@ -433,11 +3237,15 @@ static LRESULT CALLBACK GetMsgProc(int nCode, WPARAM wParam, LPARAM lParam) {
                 }
             } else if (target) {
                 // For MDI child, stop at the child and prefer screen capture; otherwise use PrintWindow overlay
-                CaptureWindow(target, !isMdi);
+                if (g_coalesceMs > 0) {
+                    ScheduleCapture(target, !isMdi);
+                } else if (!StartBurstCapture(target, !isMdi)) {
+                    CaptureWindow(target, !isMdi);
+                }
             }
         }
     }
-    return CallNextHookEx(g_hHook, nCode, wParam, lParam);
+    return CallNextHookEx(t_hHook, nCode, wParam, lParam);
 }
 
 extern "C" __declspec(dllexport) void WINAPI RecordScreen(const char* path) {
@@ -449,27 +3257,211 @@ extern "C" __declspec(dllexport) void WINAPI RecordScreen(const char* path) {
     MultiByteToWideChar(CP_UTF8, 0, path, -1, &wpath[0], len);
     // Remove any trailing null character that std::wstring includes
     if (!wpath.empty() && wpath.back() == L'\0') wpath.pop_back();
-    g_basePath = wpath;
+    wcsncpy_s(t_basePath, _countof(t_basePath), wpath.c_str(), _TRUNCATE);
+
+    // One directory scan up front makes every later filename unique-check an
+    // in-memory lookup.
+    SeedNameIndex(wpath);
+
+    // Open the capture journal alongside the output directory.
+    JournalEnsureOpen(t_basePath);
+
+    // Start the background encoder before the first capture can happen.
+    EnsureEncodeThread();
 
     // Install a thread‑local hook for the current thread only once.
-    // Subsequent calls only update the base path.
-    if (!g_hHook) {
-        g_hHook = SetWindowsHookExW(WH_GETMESSAGE, GetMsgProc, g_hInst, GetCurrentThreadId());
+    // Subsequent calls only update this thread's base path.
+    if (!t_hHook) {
+        t_hHook = SetWindowsHookExW(WH_GETMESSAGE, GetMsgProc, g_hInst, GetCurrentThreadId());
+        if (t_hHook) {
+            // Record the hook so process detach can unhook every thread
+            LONG tid = (LONG)GetCurrentThreadId();
+            for (int i = 0; i < HOOK_SLOTS_MAX; ++i) {
+                if (InterlockedCompareExchange(&g_hookSlots[i].threadId, tid, 0) == 0) {
+                    g_hookSlots[i].hook = t_hHook;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Options for RecordScreenEx. cbSize allows the struct to grow without
+// breaking older callers; fields beyond the caller's cbSize keep defaults.
+typedef struct tagScreenCaptureOptions {
+    DWORD cbSize;
+    int compressionLevel; // CaptureCompressionLevel: 0 fast, 1 default, 2 best
+    int burstFrames;      // >1 turns F11 into a burst of this many frames
+    int burstFps;         // burst rate, frames per second (default 10)
+    int burstIncremental; // 1 (default): diff burst frames, skip unchanged,
+                          // crop small changes to the dirty row band; 0: keep all
+    int outputFormat;     // CaptureFormat: 0 png, 1 bmp, 2 qoi, 3 jpeg,
+                          // 4 banded qoi (.qot, parallel per-band encode)
+    int jpegQuality;      // 1..100, lossy mode only (default 90)
+    int retainedFrames;   // >0: hold the last N captures in memory and only
+                          // encode/save them when FlushCaptures() is called
+    int maxOutputWidth;   // >0: box-filter frames wider than this down to it
+                          // before encoding (e.g. 1280 for thumbnails)
+    int coalesceMs;       // F11 debounce window, ms (default 150); repeats
+                          // for the same window merge into one capture;
+                          // 0 captures inline with no debouncing
+    const char* roiClass; // window class (UTF-8) the ROI below applies to;
+                          // captures of matching windows grab only that
+                          // client-coordinate rect (empty rect clears it)
+    int roiLeft, roiTop, roiRight, roiBottom;
+    int dedupeFrames;     // 1: drop captures whose content hash matches the
+                          // last kept capture of the same window
+    int printTimeoutMs;   // deadline for the PrintWindow refinement; past it
+                          // the screen seed ships as-is (0 = wait inline)
+    int governorEnabled;  // 0 disables the backpressure governor (default on)
+    int governorQueueHi;  // encode-queue depth that steps quality down
+    int governorMemHiMb;  // in-flight write MB that steps quality down
+} ScreenCaptureOptions;
+
+// True when the caller's struct is new enough to contain the given field.
+#define OPTIONS_HAS(o, f) ((o)->cbSize >= FIELD_OFFSET(ScreenCaptureOptions, f) + sizeof((o)->f))
+
+extern "C" __declspec(dllexport) void WINAPI RecordScreenEx(const char* path, const ScreenCaptureOptions* options) {
+    if (options) {
+        if (OPTIONS_HAS(options, compressionLevel) &&
+            options->compressionLevel >= CompressionFast && options->compressionLevel <= CompressionBest) {
+            InterlockedExchange(&g_compressionLevel, options->compressionLevel);
+        }
+        if (OPTIONS_HAS(options, burstFrames) && options->burstFrames >= 1) {
+            InterlockedExchange(&g_burstFrames, options->burstFrames);
+        }
+        if (OPTIONS_HAS(options, burstFps) && options->burstFps >= 1 && options->burstFps <= 60) {
+            InterlockedExchange(&g_burstFps, options->burstFps);
+        }
+        if (OPTIONS_HAS(options, burstIncremental)) {
+            InterlockedExchange(&g_burstIncremental, options->burstIncremental ? 1 : 0);
+        }
+        if (OPTIONS_HAS(options, outputFormat) &&
+            options->outputFormat >= FormatPng && options->outputFormat <= FormatQoiBanded) {
+            InterlockedExchange(&g_outputFormat, options->outputFormat);
+        }
+        if (OPTIONS_HAS(options, jpegQuality) &&
+            options->jpegQuality >= 1 && options->jpegQuality <= 100) {
+            InterlockedExchange(&g_jpegQuality, options->jpegQuality);
+        }
+        if (OPTIONS_HAS(options, retainedFrames) &&
+            options->retainedFrames >= 0 && options->retainedFrames <= RETAIN_RING_MAX) {
+            // Resizing the ring invalidates its slot indexing; drop any
+            // frames captured under the old size rather than mis-aging them.
+            if (options->retainedFrames != g_retainFrames) ClearRetainRing();
+            InterlockedExchange(&g_retainFrames, options->retainedFrames);
+        }
+        if (OPTIONS_HAS(options, maxOutputWidth) && options->maxOutputWidth >= 0) {
+            InterlockedExchange(&g_maxOutputWidth, options->maxOutputWidth);
+        }
+        if (OPTIONS_HAS(options, coalesceMs) &&
+            options->coalesceMs >= 0 && options->coalesceMs <= 1000) {
+            InterlockedExchange(&g_coalesceMs, options->coalesceMs);
+        }
+        if (OPTIONS_HAS(options, roiBottom) && options->roiClass) {
+            RECT rc = { options->roiLeft, options->roiTop,
+                        options->roiRight, options->roiBottom };
+            SetWindowRoi(options->roiClass, rc);
+        }
+        if (OPTIONS_HAS(options, dedupeFrames)) {
+            InterlockedExchange(&g_dedupeFrames, options->dedupeFrames ? 1 : 0);
+        }
+        if (OPTIONS_HAS(options, printTimeoutMs) && options->printTimeoutMs >= 0) {
+            InterlockedExchange(&g_printTimeoutMs, options->printTimeoutMs);
+        }
+        if (OPTIONS_HAS(options, governorEnabled)) {
+            InterlockedExchange(&g_governEnabled, options->governorEnabled ? 1 : 0);
+        }
+        if (OPTIONS_HAS(options, governorQueueHi) && options->governorQueueHi > 0) {
+            InterlockedExchange(&g_governQueueHi, options->governorQueueHi);
+        }
+        if (OPTIONS_HAS(options, governorMemHiMb) && options->governorMemHiMb > 0) {
+            InterlockedExchange(&g_governMemHiMb, options->governorMemHiMb);
+        }
+        GovernRebase();
+    }
+    RecordScreen(path);
+}
+
+// Copies a snapshot of the per-stage timing counters. Callers set cbSize to
+// the size of their struct before the call; at most that many bytes are
+// written, so older callers keep working as stages are added. Out-of-process
+// monitors can instead map "Local\ScreenCaptureStats_<pid>" directly.
+extern "C" __declspec(dllexport) void WINAPI GetCaptureStats(CaptureStats* out) {
+    if (!out || out->cbSize < sizeof(DWORD)) return;
+    DWORD want = out->cbSize;
+    if (want > sizeof(CaptureStats)) want = sizeof(CaptureStats);
+    memcpy(out, GetStatsBlock(), want);
+    out->cbSize = want;
+}
+
+// Encodes and writes every frame currently held in the retained ring,
+// oldest first so the -N name suffixes follow capture order. Safe to call
+// from any thread, including while more captures are arriving.
+extern "C" __declspec(dllexport) void WINAPI FlushCaptures(void) {
+    for (;;) {
+        HBITMAP bmp = NULL;
+        WCHAR base[MAX_PATH];
+        AcquireSRWLockExclusive(&g_retainLock);
+        if (g_retainCount > 0) {
+            LONG size = g_retainFrames;
+            if (size < 1) size = 1;
+            if (size > RETAIN_RING_MAX) size = RETAIN_RING_MAX;
+            int idx = (g_retainHead - g_retainCount + 2 * (int)size) % (int)size;
+            bmp = g_retainRing[idx].bmp;
+            g_retainRing[idx].bmp = NULL;
+            wcscpy_s(base, g_retainRing[idx].base);
+            g_retainCount--;
+        }
+        ReleaseSRWLockExclusive(&g_retainLock);
+        if (!bmp) break;
+        SubmitNamedCapture(bmp, base);
     }
 }
 
+// Captures every visible top-level window of the process in one batch
+// pass; call on a thread that has called RecordScreen, since the files
+// are named under that thread's output directory.
+extern "C" __declspec(dllexport) void WINAPI CaptureAllWindows(void) {
+    CaptureAllProcessWindows();
+}
+
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved) {
     switch (ul_reason_for_call) {
-    case DLL_PROCESS_ATTACH: {
+    case DLL_PROCESS_ATTACH:
+        // Nothing but the module handle: backend init is deferred to the
+        // first capture (EnsureCaptureInit), keeping load cheap for the
+        // ~90% of sessions that never press F11.
         g_hInst = hModule;
-        GdiplusStartupInput gdiplusStartupInput;
-        GdiplusStartup(&g_gdiplusToken, &gdiplusStartupInput, NULL);
         break;
-    }
+    case DLL_THREAD_DETACH:
+        // Burst/batch/record workers exit between captures; hand back every
+        // per-thread allocation (plain thread_local pointers get no
+        // destructor): the arena slab, the downscale accumulator, and the
+        // WIC factory with its COM init.
+        ArenaRelease();
+        ScaleAccRelease();
+        WicRelease();
+        break;
     case DLL_PROCESS_DETACH: {
-        if (g_hHook) {
-            UnhookWindowsHookEx(g_hHook);
-            g_hHook = NULL;
+        for (int i = 0; i < HOOK_SLOTS_MAX; ++i) {
+            if (g_hookSlots[i].threadId && g_hookSlots[i].hook) {
+                UnhookWindowsHookEx(g_hookSlots[i].hook);
+                g_hookSlots[i].hook = NULL;
+            }
+        }
+        // Ask the encoder thread to exit. Joining it here would deadlock on
+        // the loader lock, so just signal; on process exit the thread is torn
+        // down with the process anyway.
+        // Same loader-lock rule for a live recording: signal, never join.
+        if (g_recording) {
+            InterlockedExchange(&g_recording->stop, 1);
+        }
+        if (g_encodeThread) {
+            InterlockedExchange(&g_encodeStop, 1);
+            ReleaseSemaphore(g_encodeWake, 1, NULL);
+            CloseHandle(g_encodeThread);
+            g_encodeThread = NULL;
         }
         if (g_gdiplusToken) {
             GdiplusShutdown(g_gdiplusToken);
@@ -0,0 +1,67 @@
+// Internal seams shared by the DLL and the ScreenCaptureBench harness. Both
+// link the same object file (ScreenCaptureCore in CMake), so the bench times
+// exactly the code the DLL ships. Nothing in this header is public API; the
+// public surface is RecordScreen/RecordScreenEx/FlushCaptures/GetCaptureStats
+// (see README).
+#pragma once
+#include <windows.h>
+
+// PNG filtering effort; "fast" skips filtering for a several-times-faster
+// encode at ~15% larger files.
+enum CaptureCompressionLevel {
+    CompressionFast = 0,
+    CompressionDefault = 1,
+    CompressionBest = 2,
+};
+
+// Output container. PNG stays the default; BMP is a raw header+bits dump,
+// QOI is a single-pass byte-oriented lossless codec (~4x faster than even
+// fast PNG), JPEG is the lossy option with a quality knob.
+enum CaptureFormat {
+    FormatPng = 0,
+    FormatBmp = 1,
+    FormatQoi = 2,
+    FormatJpeg = 3,
+    FormatQoiBanded = 4, // internal .qot container: per-band QOI streams
+                         // compressed in parallel (for consumers that accept it)
+};
+
+// Stages tracked by the timing counters (see GetCaptureStats in README).
+enum CaptureStatStage {
+    StageBlit = 0,    // screen seed: DXGI/BitBlt into the capture DIB
+    StagePrintWindow, // PrintWindow refinement pass
+    StageEncode,      // bitmap -> PNG/BMP/QOI/JPEG bytes
+    StageWrite,       // file I/O: synchronous writes and overlapped issue/waits
+    StageStatCount
+};
+
+struct CaptureStageStats {
+    volatile LONG64 count;
+    volatile LONG64 totalQpc; // sum of elapsed QPC ticks across all calls
+    volatile LONG64 maxQpc;   // slowest single call, in QPC ticks
+};
+
+struct CaptureStats {
+    DWORD cbSize;        // sizeof(CaptureStats), written by the DLL
+    DWORD reserved;
+    LONG64 qpcFrequency; // divide tick fields by this for seconds
+    CaptureStageStats stage[StageStatCount];
+    volatile LONG64 duplicatesSkipped; // captures dropped by frame dedupe
+    volatile LONG governorLevel;         // current backpressure step, 0 = native
+    LONG reservedGovernor;
+    volatile LONG64 governorTransitions; // governor level changes since load
+};
+
+// Tuning knobs, normally set through RecordScreenEx; the bench pokes them
+// directly between runs.
+extern volatile LONG g_compressionLevel; // CaptureCompressionLevel
+extern volatile LONG g_outputFormat;     // CaptureFormat
+extern volatile LONG g_jpegQuality;      // 1..100, lossy mode only
+extern volatile LONG g_maxOutputWidth;   // 0 = encode at capture size
+
+// Pipeline pieces the bench drives directly.
+HBITMAP CreateCaptureDib(int w, int h, void** bits);
+HBITMAP DownscaleFrame(HBITMAP src); // NULL when no scaling applies
+HBITMAP RenderWindowFrame(HWND hwnd); // grab stage only; NULL on failure
+void SaveCaptureBitmap(HBITMAP hBmp, const WCHAR* path, bool asyncWrite);
+CaptureStats* GetStatsBlock();